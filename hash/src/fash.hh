@@ -1,9 +1,22 @@
+#pragma once
+
 #include <immintrin.h>
 #include <new>
 #include <cstdlib>
 #include <functional>
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <vector>
 #include <strings.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
 
 // fash serialization:
 //   - every value has a 64-bit hash
@@ -24,7 +37,565 @@
 //
 // math reference: https://crypto.stackexchange.com/questions/27370/formula-for-the-number-of-expected-collisions/27372
 
-template <class K, class V>
+// table storage comes straight from anonymous mmap. the pages are already zero
+// and page aligned, so a fresh table costs nothing until its slots are touched,
+// which is what lets fash_growable allocate a doubled table mid-insert.
+//
+// where the pages come from is a policy, the trailing A parameter of fash and
+// fash128x. a random lookup into a table of hundreds of MB misses the dTLB as
+// often as it misses the cache, and one 2 MB page covers what 512 small pages
+// would:
+//   - fash_small_pages: plain 4 KB pages, the default.
+//   - fash_thp_pages: 2 MB aligned and madvise(MADV_HUGEPAGE), so the kernel
+//     backs it with transparent huge pages when THP is "madvise" or "always".
+//   - fash_huge_pages: MAP_HUGETLB from the reserved pool (vm.nr_hugepages),
+//     falling back to fash_thp_pages when the pool can't cover it.
+// the huge policies round sizes up to 2 MB, which small tables pay for in
+// address space only.
+struct fash_small_pages {
+    static void* alloc(uint64_t bytes) {
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(p == MAP_FAILED)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    static void free(void* p, uint64_t bytes) {
+        munmap(p, bytes);
+    }
+};
+
+struct fash_thp_pages {
+    static constexpr uint64_t page = 2ULL << 20;
+
+    static uint64_t round(uint64_t bytes) { return (bytes + page - 1) & ~(page - 1); }
+
+    // over-map by a page and trim, so the mapping starts on a 2 MB boundary.
+    static void* alloc(uint64_t bytes) {
+        const uint64_t len = round(bytes);
+        char* p = static_cast<char*>(mmap(nullptr, len + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if(p == MAP_FAILED)
+            throw std::bad_alloc();
+        char* aligned = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + page - 1) & ~(page - 1));
+        if(aligned != p)
+            munmap(p, aligned - p);
+        munmap(aligned + len, p + page - aligned);
+        madvise(aligned, len, MADV_HUGEPAGE);
+        return aligned;
+    }
+
+    static void free(void* p, uint64_t bytes) {
+        munmap(p, round(bytes));
+    }
+};
+
+struct fash_huge_pages {
+    static void* alloc(uint64_t bytes) {
+        void* p = mmap(nullptr, fash_thp_pages::round(bytes), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        return p == MAP_FAILED ? fash_thp_pages::alloc(bytes) : p;
+    }
+
+    // both paths map exactly round(bytes), so one munmap fits either.
+    static void free(void* p, uint64_t bytes) {
+        fash_thp_pages::free(p, bytes);
+    }
+};
+
+// fash_touched_pages: A's pages, written once by the allocating thread. linux
+// places a page on the node of the thread that first writes it, so this puts
+// the whole table on the allocating thread's node up front rather than
+// wherever each page's first insert happens to run. fash_sharded builds every
+// shard on its owner thread for exactly this.
+template <class A = fash_small_pages>
+struct fash_touched_pages {
+    static void* alloc(uint64_t bytes) {
+        volatile char* p = static_cast<char*>(A::alloc(bytes));
+        for(uint64_t i = 0; i < bytes; i += 4096)
+            p[i] = 0;
+        return const_cast<char*>(p);
+    }
+
+    static void free(void* p, uint64_t bytes) {
+        A::free(p, bytes);
+    }
+};
+
+// fash_heap: zeroed, cache line aligned memory from operator new, for small
+// arrays that grow often (fash_stash), where a mapping per growth would cost
+// two syscalls and a page fault per 4 KB.
+struct fash_heap {
+    static void* alloc(uint64_t bytes) {
+        void* p = ::operator new(bytes, std::align_val_t{64});
+        memset(p, 0, bytes);
+        return p;
+    }
+
+    static void free(void* p, uint64_t) {
+        ::operator delete(p, std::align_val_t{64});
+    }
+};
+
+template <class T, class A = fash_small_pages>
+T* fash_zalloc(uint64_t n) {
+    return static_cast<T*>(A::alloc(n * sizeof(T)));
+}
+
+template <class T, class A = fash_small_pages>
+void fash_free(T* p, uint64_t n) {
+    A::free(p, n * sizeof(T));
+}
+
+// FASH_STATS (off by default, cmake -DFASH_STATS=ON) makes fash and fash128x
+// count what their find_int64 and at_batch probes do, and adds stats(), which
+// walks the table for occupancy and returns everything as a fash_stats. with
+// the flag off neither the counters nor stats() exist, so the probe loops
+// compile exactly as before.
+#ifdef FASH_STATS
+#include <string>
+#define FASH_STAT(x) x
+#else
+#define FASH_STAT(x)
+#endif
+
+#ifdef FASH_STATS
+// counters the probes bump. distance[i] is how many hits were found i lines
+// past the line their probe started on (the guess line for fash128x). lines
+// counts 64-byte lines of keys and values read, misses included.
+struct fash_probe_counters {
+    uint64_t lookups = 0, hits = 0, lines = 0;
+    uint64_t distance[16] = {};
+};
+
+struct fash_stats {
+    uint64_t keys = 0, slots = 0, buckets = 0;
+    std::vector<uint64_t> fill;        // fill[i]: buckets holding i keys
+    fash_probe_counters probes;
+    uint64_t stashed = 0, overflows = 0;
+
+    double load_factor() const { return slots ? double(keys) / slots : 0; }
+    double lines_per_lookup() const { return probes.lookups ? double(probes.lines) / probes.lookups : 0; }
+
+    double mean_distance() const {
+        uint64_t sum = 0;
+        for(int i = 0; i < 16; ++i)
+            sum += i * probes.distance[i];
+        return probes.hits ? double(sum) / probes.hits : 0;
+    }
+
+    std::string json() const {
+        auto list = [](const uint64_t* v, size_t n) {
+            std::string s = "[";
+            for(size_t i = 0; i < n; ++i)
+                s += (i ? "," : "") + std::to_string(v[i]);
+            return s + "]";
+        };
+
+        return "{\"keys\":" + std::to_string(keys) +
+               ",\"slots\":" + std::to_string(slots) +
+               ",\"buckets\":" + std::to_string(buckets) +
+               ",\"load_factor\":" + std::to_string(load_factor()) +
+               ",\"fill\":" + list(fill.data(), fill.size()) +
+               ",\"lookups\":" + std::to_string(probes.lookups) +
+               ",\"hits\":" + std::to_string(probes.hits) +
+               ",\"lines_per_lookup\":" + std::to_string(lines_per_lookup()) +
+               ",\"distance\":" + list(probes.distance, 16) +
+               ",\"stashed\":" + std::to_string(stashed) +
+               ",\"overflows\":" + std::to_string(overflows) + "}";
+    }
+};
+#endif
+
+// hash policies: every table takes one as its last template parameter and
+// calls it wherever it used to call its own copy of unhash. each is stateless
+// and has a scalar and an __m512i form that agree lane for lane, so the
+// batched paths hash 8 keys at a time whichever policy is picked. only the low
+// bits choose the bucket (the 128 slot tables also read the top 7), keys are
+// still compared in full.
+
+// the default: the xorshift-multiply mixer the tables always used. bijective.
+struct fash_mix_hash {
+    static constexpr unsigned int id = 1;   // recorded in snapshots
+
+    inline __attribute__((always_inline)) uint64_t operator()(uint64_t x) const {
+        x = (x ^ (x >> 31) ^ (x >> 62)) * UINT64_C(0x319642b2d24d8ec3);
+        x = (x ^ (x >> 27) ^ (x >> 54)) * UINT64_C(0x96de1b173f119089);
+        x = x ^ (x >> 30) ^ (x >> 60);
+        return x;
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(__m512i x) const {
+        auto a = _mm512_srli_epi64(x, 31);
+        auto b = _mm512_srli_epi64(x, 62);
+        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), _mm512_set1_epi64(UINT64_C(0x319642b2d24d8ec3)));
+        a = _mm512_srli_epi64(x, 27);
+        b = _mm512_srli_epi64(x, 54);
+        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), _mm512_set1_epi64(UINT64_C(0x96de1b173f119089)));
+        a = _mm512_srli_epi64(x, 30);
+        b = _mm512_srli_epi64(x, 60);
+        return _mm512_xor_epi64(x, _mm512_xor_epi64(a, b));
+    }
+};
+
+// crc32c of the key (low half) and of the key rotated by 32 (high half). the
+// crc instruction has no 512-bit form, so the vector version runs it per lane.
+struct fash_crc_hash {
+    static constexpr unsigned int id = 2;   // recorded in snapshots
+
+    inline __attribute__((always_inline)) uint64_t operator()(uint64_t x) const {
+        const uint64_t lo = _mm_crc32_u64(0, x);
+        const uint64_t hi = _mm_crc32_u64(0, (x >> 32) | (x << 32));
+        return (hi << 32) | lo;
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(__m512i x) const {
+        alignas(64) uint64_t k[8];
+        _mm512_store_epi64(k, x);
+        for(int i = 0; i < 8; ++i)
+            k[i] = (*this)(k[i]);
+        return _mm512_load_epi64(k);
+    }
+};
+
+// two aes rounds over the key copied into both halves of a 128-bit block. an
+// aes round mixes the whole 128-bit lane, so the vector form unpacks even and
+// odd keys into lanes of their own, runs both halves through vaes, and packs
+// the low qwords back into key order.
+struct fash_aes_hash {
+    static constexpr unsigned int id = 3;   // recorded in snapshots
+
+    inline __attribute__((always_inline)) uint64_t operator()(uint64_t x) const {
+        auto b = _mm_xor_si128(_mm_set1_epi64x(x), _mm_set1_epi64x(UINT64_C(0x243f6a8885a308d3)));
+        b = _mm_aesenc_si128(b, _mm_set1_epi64x(UINT64_C(0x13198a2e03707344)));
+        b = _mm_aesenc_si128(b, _mm_set1_epi64x(UINT64_C(0xa4093822299f31d0)));
+        return _mm_cvtsi128_si64(b);
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(__m512i x) const {
+        const auto k0 = _mm512_set1_epi64(UINT64_C(0x243f6a8885a308d3));
+        const auto k1 = _mm512_set1_epi64(UINT64_C(0x13198a2e03707344));
+        const auto k2 = _mm512_set1_epi64(UINT64_C(0xa4093822299f31d0));
+        auto even = _mm512_xor_epi64(_mm512_unpacklo_epi64(x, x), k0);
+        auto odd = _mm512_xor_epi64(_mm512_unpackhi_epi64(x, x), k0);
+        even = _mm512_aesenc_epi128(_mm512_aesenc_epi128(even, k1), k2);
+        odd = _mm512_aesenc_epi128(_mm512_aesenc_epi128(odd, k1), k2);
+        return _mm512_unpacklo_epi64(even, odd);
+    }
+};
+
+// multiply-shift: one multiply by an odd constant, whose good bits are the high
+// ones, rotated by 32 so they land where the bucket index is taken. the cheapest
+// of the four and bijective, but weaker on keys differing only in high bits.
+struct fash_mulshift_hash {
+    static constexpr unsigned int id = 4;   // recorded in snapshots
+
+    inline __attribute__((always_inline)) uint64_t operator()(uint64_t x) const {
+        x *= UINT64_C(0x9e3779b97f4a7c15);
+        return (x >> 32) | (x << 32);
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(__m512i x) const {
+        return _mm512_ror_epi64(_mm512_mullox_epi64(x, _mm512_set1_epi64(UINT64_C(0x9e3779b97f4a7c15))), 32);
+    }
+};
+
+// the identity, for keys that already are well mixed hashes (fash_symbols
+// stores symbol hashes). mixing them again would only add latency.
+struct fash_prehashed {
+    static constexpr unsigned int id = 5;   // recorded in snapshots
+
+    inline __attribute__((always_inline)) uint64_t operator()(uint64_t x) const {
+        return x;
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(__m512i x) const {
+        return x;
+    }
+};
+
+// fash_stash: where keys go once their bucket is full, instead of the bare
+// throw. it's a flat array of keys (plus a parallel value array) searched 8
+// keys per compare, doubling in fash_heap memory whenever it fills. tables only consult it after
+// missing in a bucket that is full, so keys that fit in their bucket never pay
+// for it, and neither do misses on buckets with room left.
+template <class V>
+class fash_stash {
+    uint64_t* __restrict m_keys = nullptr;
+    V* __restrict m_values = nullptr;
+    uint64_t m_size = 0, m_capacity = 0;
+    // set tables stash bare keys.
+    static constexpr bool has_values = !std::is_empty_v<V>;
+
+public:
+    fash_stash() = default;
+    fash_stash(const fash_stash &) = delete;
+    fash_stash & operator=(const fash_stash &) = delete;
+
+    ~fash_stash() {
+        if(m_capacity) {
+            fash_free<uint64_t, fash_heap>(m_keys, m_capacity);
+            if constexpr (has_values)
+                fash_free<V, fash_heap>(m_values, m_capacity);
+        }
+    }
+
+    void push(const uint64_t & key, V value) {
+        if(m_size == m_capacity)
+            reserve(m_capacity ? m_capacity * 2 : 64);
+        m_keys[m_size] = key;
+        if constexpr (has_values)
+            m_values[m_size] = value;
+        ++m_size;
+    }
+
+    inline bool contains(const uint64_t & key) const {
+        return index_of(key) != m_size;
+    }
+
+    inline V * find(const uint64_t & key) const {
+        const auto i = index_of(key);
+        return i == m_size ? nullptr : m_values + i;
+    }
+
+    // the last entry fills the hole, so slots past m_size stay zero and the
+    // 8-wide scan in index_of never needs a tail mask.
+    bool erase(const uint64_t & key) {
+        const auto i = index_of(key);
+        if(i == m_size)
+            return false;
+        remove(i);
+        return true;
+    }
+
+    // removes every entry whose key satisfies pred, handing each to f(key, value).
+    // f must not change this stash.
+    template <class P, class F>
+    void drain_if(P && pred, F && f) {
+        for(uint64_t i = 0; i < m_size;) {
+            if(pred(m_keys[i])) {
+                if constexpr (has_values) {
+                    f(m_keys[i], m_values[i]);
+                } else {
+                    V empty;
+                    f(m_keys[i], empty);
+                }
+                remove(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    uint64_t size() const { return m_size; }
+    uint64_t capacity() const { return m_capacity; }
+
+    // the first size() entries, for iteration and export.
+    const uint64_t* keys() const { return m_keys; }
+    V* values() const { return m_values; }
+
+private:
+    inline uint64_t index_of(const uint64_t & key) const {
+        const auto kk = _mm512_set1_epi64(key);
+        for(uint64_t i = 0; i < m_size; i += 8) {
+            unsigned short mask = _mm512_cmp_epi64_mask(kk, _mm512_load_epi64(m_keys + i), _MM_CMPINT_EQ);
+            if(mask)
+                return i + __builtin_ctz(mask);
+        }
+        return m_size;
+    }
+
+    void remove(uint64_t i) {
+        --m_size;
+        m_keys[i] = m_keys[m_size];
+        if constexpr (has_values)
+            m_values[i] = m_values[m_size];
+        m_keys[m_size] = 0;
+    }
+
+    void reserve(uint64_t capacity) {
+        auto keys = fash_zalloc<uint64_t, fash_heap>(capacity);
+        if(m_capacity) {
+            memcpy(keys, m_keys, m_size * sizeof(uint64_t));
+            fash_free<uint64_t, fash_heap>(m_keys, m_capacity);
+        }
+        m_keys = keys;
+
+        if constexpr (has_values) {
+            auto values = fash_zalloc<V, fash_heap>(capacity);
+            if(m_capacity) {
+                memcpy(values, m_values, m_size * sizeof(V));
+                fash_free<V, fash_heap>(m_values, m_capacity);
+            }
+            m_values = values;
+        }
+        m_capacity = capacity;
+    }
+};
+
+// fash_iterator: forward iteration over the live slots of a table that keeps
+// keys and values in parallel arrays, then over its stash if it has one. *it
+// is an entry holding the key and a reference to the value. it steps one slot
+// at a time; export_to is the fast way to walk a whole table.
+template <class V>
+class fash_iterator {
+    const uint64_t* m_key[2] = {};
+    V* m_value[2] = {};
+    uint64_t m_n[2] = {};
+    unsigned int m_seg = 2;   // 2 is the end
+    uint64_t m_i = 0;
+
+public:
+    struct entry {
+        uint64_t key;
+        V & value;
+    };
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = entry;
+
+    fash_iterator() = default;
+
+    fash_iterator(const uint64_t* key, V* value, uint64_t n, const uint64_t* stash_key = nullptr, V* stash_value = nullptr, uint64_t stash_n = 0) {
+        m_key[0] = key;
+        m_value[0] = value;
+        m_n[0] = n;
+        m_key[1] = stash_key;
+        m_value[1] = stash_value;
+        m_n[1] = stash_n;
+        m_seg = 0;
+        settle();
+    }
+
+    entry operator*() const { return {m_key[m_seg][m_i], m_value[m_seg][m_i]}; }
+
+    fash_iterator & operator++() {
+        ++m_i;
+        settle();
+        return *this;
+    }
+
+    fash_iterator operator++(int) {
+        auto before = *this;
+        ++*this;
+        return before;
+    }
+
+    bool operator==(const fash_iterator & other) const {
+        return m_seg == other.m_seg && (m_seg == 2 || m_i == other.m_i);
+    }
+
+private:
+    void settle() {
+        while(m_seg < 2) {
+            while(m_i < m_n[m_seg] && !m_key[m_seg][m_i])
+                ++m_i;
+            if(m_i < m_n[m_seg])
+                return;
+            ++m_seg;
+            m_i = 0;
+        }
+    }
+};
+
+// packs the live entries of slots [first, last) (multiples of 8) densely into
+// keys/values: one compare and one compressstore per 8 slots, plus one more
+// for the values when they are 8 bytes. returns how many were written.
+template <class V>
+uint64_t fash_compress_slots(const uint64_t* location, const V* data, uint64_t first, uint64_t last, uint64_t* keys, V* values) {
+    uint64_t out = 0;
+    for(uint64_t slot = first; slot < last; slot += 8) {
+        const auto b = _mm512_load_epi64(location + slot);
+        const __mmask8 live = _mm512_test_epi64_mask(b, b);
+        if(!live)
+            continue;
+
+        _mm512_mask_compressstoreu_epi64(keys + out, live, b);
+        if constexpr (sizeof(V) == 8 && std::is_trivially_copyable_v<V>) {
+            _mm512_mask_compressstoreu_epi64(values + out, live, _mm512_loadu_epi64(data + slot));
+        } else {
+            uint64_t o = out;
+            for(unsigned int m = live; m; m &= m - 1)
+                values[o++] = data[slot + __builtin_ctz(m)];
+        }
+        out += __builtin_popcount(live);
+    }
+    return out;
+}
+
+inline uint64_t fash_count_slots(const uint64_t* location, uint64_t first, uint64_t last) {
+    uint64_t n = 0;
+    for(uint64_t slot = first; slot < last; slot += 8) {
+        const auto b = _mm512_load_epi64(location + slot);
+        n += __builtin_popcount(_mm512_test_epi64_mask(b, b));
+    }
+    return n;
+}
+
+// fash snapshots: a table saved as a 4096-byte header followed by the raw key
+// array, the raw value array and then the stash. opening one maps the file
+// privately and points the table at it, so there is no per-entry work and the
+// pages come in as lookups touch them (or all at once with fash_open_populate).
+// writes to an opened table stay in memory; the file is never modified.
+struct fash_snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;       // slots per bucket
+    uint32_t hash;         // H::id
+    uint32_t value_size;
+    uint64_t bit_size;
+    uint64_t slots;
+    uint64_t stashed;
+    uint64_t checksum;     // fash_checksum of keys, then values, then stash, chained by seed
+};
+
+enum fash_open_mode : unsigned int {
+    fash_open_lazy = 0,
+    fash_open_populate = 1,   // MAP_POPULATE: fault every page in before returning
+    fash_open_verify = 2,     // recompute the checksum and throw on a mismatch
+};
+
+static constexpr char fash_snapshot_magic[8] = {'f', 'a', 's', 'h', 's', 'n', 'a', 'p'};
+static constexpr uint64_t fash_snapshot_page = 4096;
+
+// 8 lanes of multiply-xor over 64 bytes at a time, folded at the end. it reads
+// at memory speed; it catches truncation and corruption, not tampering.
+inline uint64_t fash_checksum(const void* p, uint64_t bytes, uint64_t seed = 0) {
+    const auto m = _mm512_set1_epi64(UINT64_C(0x9e3779b97f4a7c15));
+    auto acc = _mm512_set1_epi64(seed ^ bytes);
+    const char* c = static_cast<const char*>(p);
+    uint64_t i = 0;
+    for(; i + 64 <= bytes; i += 64)
+        acc = _mm512_mullox_epi64(_mm512_xor_epi64(acc, _mm512_loadu_si512(c + i)), m);
+
+    uint64_t lanes[8];
+    _mm512_storeu_epi64(lanes, acc);
+    uint64_t h = seed;
+    for(int l = 0; l < 8; ++l)
+        h = (h ^ lanes[l]) * UINT64_C(0x9e3779b97f4a7c15);
+    for(; i < bytes; ++i)
+        h = (h ^ static_cast<unsigned char>(c[i])) * UINT64_C(0x9e3779b97f4a7c15);
+    return h ^ (h >> 29);
+}
+
+// writes n bytes or throws.
+inline void fash_write_all(int fd, const void* p, uint64_t n, const char* path) {
+    const char* c = static_cast<const char*>(p);
+    while(n) {
+        const auto w = ::write(fd, c, n);
+        if(w < 0) {
+            if(errno == EINTR)
+                continue;
+            ::close(fd);
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        c += w;
+        n -= w;
+    }
+}
+
+template <class K, class V, class H = fash_mix_hash, class A = fash_small_pages>
 class fash128x {
     uint64_t* __restrict m_location;
     V* __restrict m_data;
@@ -33,46 +604,63 @@ class fash128x {
     __m512i m_vz_m1;
     const __m512i zero = _mm512_set1_epi64(0ULL);
     const __m512i one = _mm512_set1_epi64(1ULL);
-    const __m512i m_a = _mm512_set1_epi64(UINT64_C(0x319642b2d24d8ec3));
-    const __m512i m_b = _mm512_set1_epi64(UINT64_C(0x96de1b173f119089));
+#ifdef FASH_STATS
+    fash_probe_counters m_probes;
+    uint64_t m_overflows = 0;
+#endif
 
 public: 
+    using key_type = K;
+    using value_type = V;
+
     fash128x(unsigned char bit_size) {
         m_bitsz = bit_size;
         m_sz = 1 << (m_bitsz + 1); // 7 - 6 = (bucket size) - (fraction of entries)
         m_sz_m1 = (1<<(m_bitsz-6)) - 1;
         m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
-        m_location = new (std::align_val_t(64)) uint64_t[m_sz];
-        memset(m_location, 0, m_sz*sizeof(uint64_t));
-        m_data = new (std::align_val_t(64)) V[m_sz];
-        memset(m_data, 0, m_sz*sizeof(V));
+        m_location = fash_zalloc<uint64_t, A>(m_sz);
+        m_data = fash_zalloc<V, A>(m_sz);
     }
 
     ~fash128x() {
-        ::operator delete[] (m_location, std::align_val_t(64));
-        ::operator delete[] (m_data, std::align_val_t(64));
+        fash_free<uint64_t, A>(m_location, m_sz);
+        fash_free<V, A>(m_data, m_sz);
     }
 
-    // inline __attribute__((always_inline))  std::tuple<V, V, V, V, V, V, V, V> at512(__m512i key) const {
-    //     auto k = unhash(key);
-        
-    //     auto bucket = _mm512_slli_epi64(_mm512_and_epi64(k, m_vz_m1), 7);
-    //     auto b = _mm512_i64gather_epi64(bucket, m_location, 8);
-    //     auto neq = _mm512_cmp_epi64_mask(k, b, _MM_CMPINT_NE);
-    //     //std::cout << 0 << " neq " << (int)neq << std::endl;
-
-    //     while(neq) {
-    //         bucket = _mm512_mask_add_epi64(bucket, neq, bucket, one);
-    //         b = _mm512_i64gather_epi64(bucket, m_location, 8);
-    //         neq = _mm512_cmp_epi64_mask(k, b, _MM_CMPINT_NE);
-    //         //std::cout << " neq " << (int)neq << std::endl;
-    //     }
+    // resolves n keys at once. keys are hashed 8 at a time with the vectorized
+    // unhash, and the first probe line of key i + distance is prefetched while key
+    // i is being resolved, so up to `distance` DRAM misses are in flight at once.
+    // a miss scans its 128 slot bucket once and leaves out[i] alone. found (if
+    // given) gets a 0/1 per key, and the return value is the number of misses.
+    size_t at_batch(const uint64_t* keys, size_t n, V* out, unsigned char* found = nullptr, unsigned int distance = 32) {
+        uint64_t ring[batch_ring];
+        distance = std::min((distance + 7) & ~7u, batch_ring - 8);
+        size_t misses = 0;
+        size_t staged = 0;
+
+        for(; staged < n && staged < distance; staged += 8)
+            batch_stage(keys, n, staged, ring);
+
+        for(size_t i = 0; i < n; i += 8) {
+            if(staged < n) {
+                batch_stage(keys, n, staged, ring);
+                staged += 8;
+            }
 
-    //     uint64_t ind[8];
-    //     _mm512_storeu_epi64(ind, bucket);
+            const size_t end = std::min(i + 8, n);
+            for(size_t j = i; j < end; ++j) {
+                V* hit = probe_from(keys[j], ring[j & (batch_ring - 1)]);
+                if(hit)
+                    out[j] = *hit;
+                else
+                    ++misses;
+                if(found)
+                    found[j] = hit != nullptr;
+            }
+        }
 
-    //     return std::make_tuple(m_data[ind[0]], m_data[ind[1]], m_data[ind[2]], m_data[ind[3]], m_data[ind[4]], m_data[ind[5]], m_data[ind[6]], m_data[ind[7]]);
-    // }
+        return misses;
+    }
 
     inline __attribute__((always_inline))  V & at_int64v2(const uint64_t & key) {
         const uint64_t k = unhash(key);
@@ -186,7 +774,7 @@ public:
 
     void insert_no_intrinsic(const K & key) {
         const std::size_t k = std::hash<K>{}(key);
-        const unsigned int bucket = (k & m_sz_m1) << 7;
+        const unsigned int bucket = (unhash(k) & m_sz_m1) << 7;
         for(auto b = 0; b < 128; ++b)
         {
             if(m_location[bucket + b] == 0) {
@@ -198,29 +786,156 @@ public:
         throw;
     }
 
+    // same probe order as insert_no_intrinsic_int64, but 8 slots per compare and
+    // a nullptr instead of a throw when the key isn't there.
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        return probe_from(key, ((k & m_sz_m1) << 7) + (((18302628885633695744ULL & k)>>57) & 120));
+    }
+
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto k = unhash(key);
+        unsigned int guess = (18302628885633695744ULL & k)>>57;
+        const unsigned int bucket = (k & m_sz_m1) << 7;
+        unsigned int guess_next_bucket = (guess >>3) << 3;
+        guess &= 7;
+
+        for(int i = 0; i < 16; ++i)
+        {
+            for(int j = 0; j < 8; ++j)
+            {
+                auto idx = bucket + guess_next_bucket + ((j + guess) & 7);
+                if(m_location[idx] == 0) {
+                    m_location[idx] = key;
+                    m_data[idx] = data;
+                    return true;
+                }
+            }
+            guess_next_bucket += 8;
+            guess_next_bucket &= 127;
+        }
+
+        FASH_STAT(++m_overflows);
+        return false;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << 7;
+        for(int i = 0; i < 128; ++i) {
+            if(m_location[bucket + i]) {
+                f(m_location[bucket + i], m_data[bucket + i]);
+                m_location[bucket + i] = 0;
+            }
+        }
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+
+    using iterator = fash_iterator<V>;
+    iterator begin() { return iterator(m_location, m_data, m_sz); }
+    iterator end() { return iterator(); }
+
+    // live entries in buckets [first, last). export_to writes them densely to
+    // keys/values and returns the count; disjoint bucket ranges can be exported
+    // from different threads, each writing at the offset count_live gives.
+    uint64_t count_live(uint64_t first = 0, uint64_t last = ~0ULL) const {
+        last = std::min(last, bucket_count());
+        return first < last ? fash_count_slots(m_location, first << 7, last << 7) : 0;
+    }
+
+    uint64_t export_to(uint64_t* keys, V* values, uint64_t first = 0, uint64_t last = ~0ULL) const {
+        last = std::min(last, bucket_count());
+        return first < last ? fash_compress_slots(m_location, m_data, first << 7, last << 7, keys, values) : 0;
+    }
+
+#ifdef FASH_STATS
+    // occupancy is counted now, by walking every bucket; the probe counters
+    // cover every lookup since construction or the last reset_probes().
+    fash_stats stats() const {
+        fash_stats s;
+        s.slots = m_sz;
+        s.buckets = m_sz_m1 + 1;
+        s.fill.assign(129, 0);
+        for(uint64_t b = 0; b < s.buckets; ++b) {
+            unsigned int n = 0;
+            for(int i = 0; i < 128; ++i)
+                n += m_location[b * 128 + i] != 0;
+            ++s.fill[n];
+            s.keys += n;
+        }
+        s.overflows = m_overflows;
+        s.probes = m_probes;
+        return s;
+    }
+
+    void reset_probes() { m_probes = {}; }
+#endif
+
     inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
-        x = (x ^ (x >> 31) ^ (x >> 62)) * UINT64_C(0x319642b2d24d8ec3);
-        x = (x ^ (x >> 27) ^ (x >> 54)) * UINT64_C(0x96de1b173f119089);
-        x = x ^ (x >> 30) ^ (x >> 60);
-        return x;
+        return H{}(x);
     }
 
     inline __attribute__((always_inline)) __m512i unhash(__m512i x) const {
-        auto a = _mm512_srli_epi64(x, 31);
-        auto b = _mm512_srli_epi64(x, 62);
-        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), m_a);
-        a = _mm512_srli_epi64(x, 27);
-        b = _mm512_srli_epi64(x, 54);
-        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), m_b);
-        a = _mm512_srli_epi64(x, 30);
-        b = _mm512_srli_epi64(x, 60);
-        return _mm512_xor_epi64(x, _mm512_xor_epi64(a, b));
+        return H{}(x);
+    }
+
+    // pulls the key and value lines a lookup of key starts on towards the cache.
+    inline __attribute__((always_inline)) void prefetch_int64(const uint64_t & key) const {
+        const uint64_t k = unhash(key);
+        const uint64_t idx = ((k & m_sz_m1) << 7) + (((18302628885633695744ULL & k)>>57) & 120);
+        __builtin_prefetch(m_location + idx);
+        __builtin_prefetch(m_data + idx);
+    }
+private:
+    static constexpr unsigned int batch_ring = 256;
+
+    // idx is the bucket base plus the 8 slot line insert_no_intrinsic_int64 starts
+    // filling from. the lines are walked in the same order, 8 keys per compare.
+    inline __attribute__((always_inline)) V * probe_from(const uint64_t & key, uint64_t idx) {
+        const auto kk = _mm512_set1_epi64(key);
+        const uint64_t bucket = idx & ~127ULL;
+        const unsigned int start = idx & 127;
+
+        FASH_STAT(++m_probes.lookups);
+        for(int i = 0; i < 128; i+=8) {
+            const auto slot = bucket + ((start + i) & 127);
+            const auto b = _mm512_load_epi64(m_location + slot);
+            unsigned short mask = _mm512_cmp_epi64_mask(kk, b, _MM_CMPINT_EQ);
+            FASH_STAT(++m_probes.lines);
+            if(mask) {
+                FASH_STAT(++m_probes.hits; ++m_probes.lines; ++m_probes.distance[i >> 3]);
+                return m_data + __builtin_ffs(mask) - 1 + slot;
+            }
+        }
+
+        return nullptr;
+    }
+
+    // hashes keys[j, j+8) and prefetches the key and value lines they start on.
+    inline __attribute__((always_inline)) void batch_stage(const uint64_t* keys, size_t n, size_t j, uint64_t* ring) {
+        const __mmask8 live = n - j >= 8 ? 0xFF : (1 << (n - j)) - 1;
+        const auto k = unhash(_mm512_maskz_loadu_epi64(live, keys + j));
+        const auto bucket = _mm512_slli_epi64(_mm512_and_epi64(k, m_vz_m1), 7);
+        const auto start = _mm512_and_epi64(_mm512_srli_epi64(k, 57), _mm512_set1_epi64(120));
+        uint64_t* idx = ring + (j & (batch_ring - 1));
+        _mm512_storeu_epi64(idx, _mm512_add_epi64(bucket, start));
+
+        for(int l = 0; l < 8; ++l) {
+            __builtin_prefetch(m_location + idx[l]);
+            __builtin_prefetch(m_data + idx[l]);
+        }
     }
+
 };
 
 
 
-template <class K, class V>
+template <class K, class V, class H = fash_mix_hash, class A = fash_small_pages>
 class fash {
     uint64_t* __restrict m_location;
     V* __restrict m_data;
@@ -229,35 +944,147 @@ class fash {
     __m512i m_vz_m1;
     const __m512i zero = _mm512_set1_epi64(0ULL);
     const __m512i one = _mm512_set1_epi64(1ULL);
-    const __m512i m_a = _mm512_set1_epi64(UINT64_C(0x319642b2d24d8ec3));
-    const __m512i m_b = _mm512_set1_epi64(UINT64_C(0x96de1b173f119089));
+    fash_stash<V> m_stash;
+    uint64_t m_overflows = 0;
+    void* m_file = nullptr;     // the snapshot mapping, for tables that came from open
+    uint64_t m_file_len = 0;
+#ifdef FASH_STATS
+    fash_probe_counters m_probes;
+#endif
 
 public: 
+    // loc's answer when the bucket has no open slot.
+    static constexpr uint32_t npos = ~0u;
+
+    using key_type = K;
+    using value_type = V;
+
     fash(unsigned char bit_size) {
         m_bitsz = bit_size;
         m_sz = 1 << (m_bitsz + 4);
         m_sz_m1 = (1<<m_bitsz) - 1;
         m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
-        m_location = new (std::align_val_t(64)) uint64_t[m_sz];
-        memset(m_location, 0, m_sz*sizeof(uint64_t));
-        m_data = new (std::align_val_t(64)) V[m_sz];
-        memset(m_data, 0, m_sz*sizeof(V));
+        m_location = fash_zalloc<uint64_t, A>(m_sz);
+        m_data = fash_zalloc<V, A>(m_sz);
+    }
+
+    // opens a snapshot written by save(). mode is a mask of fash_open_mode.
+    // throws std::system_error if the file can't be read and
+    // std::runtime_error if it isn't a snapshot of this table type.
+    fash(const char* path, unsigned int mode = fash_open_lazy) {
+        static_assert(std::is_trivially_copyable_v<V>, "snapshots need trivially copyable values");
+        const int fd = ::open(path, O_RDONLY);
+        if(fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+
+        struct stat st;
+        fash_snapshot_header h;
+        if(fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h)) {
+            ::close(fd);
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+
+        // the header is checked field by field before any size is computed from
+        // it: bit_size is capped where fash's 32-bit slot count tops out, and the
+        // stash count by what the file could hold, so nothing below overflows.
+        constexpr uint64_t entry = sizeof(uint64_t) + sizeof(V);
+        if(memcmp(h.magic, fash_snapshot_magic, 8) != 0 || h.version != 1 || h.layout != 16 || h.hash != H::id ||
+           h.value_size != sizeof(V) || h.bit_size > 26 || h.slots != (16ULL << h.bit_size) ||
+           uint64_t(st.st_size) < fash_snapshot_page || h.stashed > uint64_t(st.st_size) / entry ||
+           uint64_t(st.st_size) != fash_snapshot_page + (h.slots + h.stashed) * entry) {
+            ::close(fd);
+            throw std::runtime_error(std::string("not a matching fash snapshot: ") + path);
+        }
+
+        m_file_len = st.st_size;
+        m_file = mmap(nullptr, m_file_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | ((mode & fash_open_populate) ? MAP_POPULATE : 0), fd, 0);
+        ::close(fd);
+        if(m_file == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), path);
+
+        char* base = static_cast<char*>(m_file) + fash_snapshot_page;
+        const uint64_t body = (h.slots + h.stashed) * entry;
+        const uint64_t keys_bytes = h.slots * sizeof(uint64_t);
+        const uint64_t values_bytes = h.slots * sizeof(V);
+        if((mode & fash_open_verify) &&
+           fash_checksum(base + keys_bytes + values_bytes, body - keys_bytes - values_bytes,
+                         fash_checksum(base + keys_bytes, values_bytes, fash_checksum(base, keys_bytes))) != h.checksum) {
+            munmap(m_file, m_file_len);
+            throw std::runtime_error(std::string("fash snapshot checksum mismatch: ") + path);
+        }
+
+        m_bitsz = h.bit_size;
+        m_sz = h.slots;
+        m_sz_m1 = (1<<m_bitsz) - 1;
+        m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
+        m_location = reinterpret_cast<uint64_t*>(base);
+        m_data = reinterpret_cast<V*>(base + m_sz * sizeof(uint64_t));
+
+        const uint64_t* stash_keys = reinterpret_cast<const uint64_t*>(base + m_sz * (sizeof(uint64_t) + sizeof(V)));
+        const V* stash_values = reinterpret_cast<const V*>(stash_keys + h.stashed);
+        for(uint64_t s = 0; s < h.stashed; ++s)
+            m_stash.push(stash_keys[s], stash_values[s]);
     }
 
     ~fash() {
-        ::operator delete[] (m_location, std::align_val_t(64));
-        ::operator delete[] (m_data, std::align_val_t(64));
+        if(m_file) {
+            munmap(m_file, m_file_len);
+            return;
+        }
+        fash_free<uint64_t, A>(m_location, m_sz);
+        fash_free<V, A>(m_data, m_sz);
     }
 
+    // writes the table to path in the format the path constructor opens.
+    void save(const char* path) const {
+        static_assert(std::is_trivially_copyable_v<V>, "snapshots need trivially copyable values");
+        const uint64_t stashed = m_stash.size();
+        char header[fash_snapshot_page] = {};
+        fash_snapshot_header h = {};
+        memcpy(h.magic, fash_snapshot_magic, 8);
+        h.version = 1;
+        h.layout = 16;
+        h.hash = H::id;
+        h.value_size = sizeof(V);
+        h.bit_size = m_bitsz;
+        h.slots = m_sz;
+        h.stashed = stashed;
+
+        std::vector<char> tail(stashed * (sizeof(uint64_t) + sizeof(V)));
+        if(stashed) {
+            memcpy(tail.data(), m_stash.keys(), stashed * sizeof(uint64_t));
+            memcpy(tail.data() + stashed * sizeof(uint64_t), m_stash.values(), stashed * sizeof(V));
+        }
+        const uint64_t keys_bytes = uint64_t(m_sz) * sizeof(uint64_t);
+        const uint64_t values_bytes = uint64_t(m_sz) * sizeof(V);
+        h.checksum = fash_checksum(tail.data(), tail.size(), fash_checksum(m_data, values_bytes, fash_checksum(m_location, keys_bytes)));
+        memcpy(header, &h, sizeof(h));
+
+        const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        fash_write_all(fd, header, sizeof(header), path);
+        fash_write_all(fd, m_location, keys_bytes, path);
+        fash_write_all(fd, m_data, values_bytes, path);
+        fash_write_all(fd, tail.data(), tail.size(), path);
+        ::close(fd);
+    }
+
+    // membership for keys stored through insert/insert_empty (by their hash).
     bool contains(const K & key) const {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
+        const auto kk = _mm512_set1_epi64(k);
         auto blo = _mm512_load_epi64(m_location + bucket);
         auto bhi = _mm512_load_epi64(m_location + bucket + 8);
-        unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
-        unsigned short openmaskhi = _mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ);
-        openmasklo |= (openmaskhi << 8);
-        return openmasklo != 0;
+        unsigned short masklo = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ);
+        unsigned short maskhi = _mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ);
+        masklo |= (maskhi << 8);
+        return masklo != 0 || (m_location[bucket + 15] && m_stash.contains(k));
+    }
+
+    bool contains_int64(const uint64_t & key) {
+        return find_int64(key) != nullptr;
     }
 
     inline __attribute__((always_inline)) std::tuple<V, V, V, V, V, V, V, V> at512(__m512i key) const {
@@ -282,7 +1109,7 @@ public:
 
     inline __attribute__((always_inline))  uint32_t loc(const K & key) const {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         auto b = _mm512_load_epi64(m_location + bucket);
         
         unsigned short omask = _mm512_cmp_epi64_mask(zero, b, _MM_CMPINT_EQ);
@@ -298,26 +1125,33 @@ public:
             return openindex + bucket + 8;
         }
 
-        throw;
+        return npos;
     }
 
     inline __attribute__((always_inline))  V& at_int64(const uint64_t & key) {
         auto k = unhash(key);
+        const auto kk = _mm512_set1_epi64(key);
         unsigned int bucket = (k & m_sz_m1) << 4;
         auto b = _mm512_load_epi64(m_location + bucket);
         
-        unsigned short omask = _mm512_cmp_epi64_mask(zero, b, _MM_CMPINT_EQ);
+        unsigned short omask = _mm512_cmp_epi64_mask(kk, b, _MM_CMPINT_EQ);
         if(omask) [[likely]] 
             return m_data[__builtin_ffs(omask) - 1 + bucket];
         
 
         b = _mm512_load_epi64(m_location + bucket + 8);
-        omask = _mm512_cmp_epi64_mask(zero, b, _MM_CMPINT_EQ);
+        omask = _mm512_cmp_epi64_mask(kk, b, _MM_CMPINT_EQ);
         if(omask) {
             auto openindex = __builtin_ffs(omask) - 1;
             return m_data[openindex + bucket + 8];
         }
 
+        if(m_location[bucket + 15]) {
+            auto stashed = m_stash.find(key);
+            if(stashed)
+                return *stashed;
+        }
+
         throw;
     }
 
@@ -330,37 +1164,53 @@ public:
                 return m_data[i + bucket];
         }
 
+        if(m_location[bucket + 15]) {
+            auto stashed = m_stash.find(key);
+            if(stashed)
+                return *stashed;
+        }
+
         throw;
     }
 
 
     inline V & at(const K & key) const {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         auto blo = _mm512_load_epi64(m_location + bucket);
         auto bhi = _mm512_load_epi64(m_location + bucket + 8);
         // why won't prefetch improve this????????
         // __builtin_prefetch(m_data + bucket);
         // __builtin_prefetch(m_data + bucket + 8);
-        unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
-        unsigned short openmaskhi = _mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ);
-        openmasklo |= (openmaskhi << 8);
-
-        if(openmasklo == 0)
+        const auto kk = _mm512_set1_epi64(k);
+        unsigned short masklo = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ);
+        unsigned short maskhi = _mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ);
+        masklo |= (maskhi << 8);
+
+        if(masklo == 0) {
+            auto stashed = m_location[bucket + 15] ? m_stash.find(k) : nullptr;
+            if(stashed)
+                return *stashed;
             throw;
+        }
 
-        auto openindex = __builtin_ffs(openmasklo) - 1;
-        return m_data[openmasklo + bucket];
+        return m_data[__builtin_ffs(masklo) - 1 + bucket];
     }
 
     inline V & at_no_intrinsic(const K & key) const {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         for(int i = 0; i < 16; ++i) {
             if(k == m_location[bucket + i])
                 return m_data[i + bucket];
         }
 
+        if(m_location[bucket + 15]) {
+            auto stashed = m_stash.find(k);
+            if(stashed)
+                return *stashed;
+        }
+
         throw;
     }
 
@@ -375,7 +1225,7 @@ public:
                 return;
             }
         }
-        throw;
+        overflow(key, data);
     }
 
     void insert_no_intrinsic_int64(const uint64_t & key) {
@@ -388,20 +1238,70 @@ public:
                 return;
             }
         }
-        throw;
+        overflow(key, V());
     }
 
-    void insert_empty_int64(const uint64_t & key) {
-        auto k = unhash(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
-        auto blo = _mm512_load_epi64(m_location + bucket);
-        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
-        unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
+    // inserts n keys 8 at a time. lanes whose bucket isn't shared with an
+    // earlier lane of the same vector (_mm512_conflict_epi64) look for a slot
+    // together: slot j of every lane still searching is gathered and compared
+    // with zero for j = 0, 1, ... and the keys and values are scattered once
+    // every lane has one. lanes that collide with an earlier lane, or whose
+    // bucket is full, go through insert_no_intrinsic_int64 after the scatter.
+    void insert_batch(const uint64_t* keys, const V* values, size_t n) {
+        for(size_t i = 0; i < n; i += 8) {
+            const __mmask8 live = n - i >= 8 ? 0xFF : (1 << (n - i)) - 1;
+            const auto kv = _mm512_maskz_loadu_epi64(live, keys + i);
+            const auto bucket = _mm512_slli_epi64(_mm512_and_epi64(unhash(kv), m_vz_m1), 4);
+            __mmask8 todo = _mm512_mask_cmpeq_epi64_mask(live, _mm512_conflict_epi64(bucket), zero);
+
+            if(i + batch_lookahead + 8 <= n) {
+                uint64_t ahead[8];
+                const auto ka = _mm512_loadu_epi64(keys + i + batch_lookahead);
+                _mm512_storeu_epi64(ahead, _mm512_slli_epi64(_mm512_and_epi64(unhash(ka), m_vz_m1), 4));
+                for(int l = 0; l < 8; ++l)
+                    __builtin_prefetch(m_location + ahead[l], 1);
+            }
+            const __mmask8 conflicted = live & ~todo;
+            __mmask8 placed = 0;
+            auto slot = bucket;
+
+            for(int j = 0; j < 16 && todo; ++j) {
+                const auto cur = _mm512_mask_i64gather_epi64(zero, todo, slot, m_location, 8);
+                const __mmask8 open = _mm512_mask_cmpeq_epi64_mask(todo, cur, zero);
+                placed |= open;
+                todo &= ~open;
+                slot = _mm512_mask_add_epi64(slot, todo, slot, one);
+            }
+
+            _mm512_mask_i64scatter_epi64(m_location, placed, slot, kv, 8);
+            if constexpr (sizeof(V) == 8) {
+                const auto vv = _mm512_maskz_loadu_epi64(placed, values + i);
+                _mm512_mask_i64scatter_epi64(m_data, placed, slot, vv, 8);
+            } else {
+                uint64_t idx[8];
+                _mm512_storeu_epi64(idx, slot);
+                for(__mmask8 p = placed; p; p &= p - 1)
+                    m_data[idx[__builtin_ctz(p)]] = values[i + __builtin_ctz(p)];
+            }
+
+            for(__mmask8 rest = conflicted | todo; rest; rest &= rest - 1)
+                insert_no_intrinsic_int64(keys[i + __builtin_ctz(rest)], values[i + __builtin_ctz(rest)]);
+        }
+    }
+
+    void insert_empty_int64(const uint64_t & key) {
+        auto k = unhash(key);
+        unsigned int bucket = (k & m_sz_m1) << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
         unsigned short openmaskhi = _mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ);
         openmasklo |= (openmaskhi << 8);
 
-        if(openmasklo == 0)
-            throw;
+        if(openmasklo == 0) {
+            overflow(k, V());
+            return;
+        }
 
         auto openindex = __builtin_ffs(openmasklo) - 1;
         m_location[openindex + bucket] = k;
@@ -410,15 +1310,17 @@ public:
 
     void insert_empty(const K & key) {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         auto blo = _mm512_load_epi64(m_location + bucket);
         auto bhi = _mm512_load_epi64(m_location + bucket + 8);
         unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
         unsigned short openmaskhi = _mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ);
         openmasklo |= (openmaskhi << 8);
 
-        if(openmasklo == 0)
-            throw;
+        if(openmasklo == 0) {
+            overflow(k, V());
+            return;
+        }
 
         auto openindex = __builtin_ffs(openmasklo) - 1;
         m_location[openindex + bucket] = k;
@@ -426,15 +1328,17 @@ public:
 
     void insert(const K & key, V && value) {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         auto blo = _mm512_load_epi64(m_location + bucket);
         auto bhi = _mm512_load_epi64(m_location + bucket + 8);
         unsigned short openmasklo = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ);
         unsigned short openmaskhi = _mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ);
         openmasklo |= (openmaskhi << 8);
 
-        if(openmasklo == 0)
-            throw;
+        if(openmasklo == 0) {
+            overflow(k, value);
+            return;
+        }
 
         auto openindex = __builtin_ffs(openmasklo) - 1;
         m_location[openindex + bucket] = k;
@@ -443,7 +1347,7 @@ public:
 
     void insert_no_intrinsic(const K & key) {
         std::size_t k = std::hash<K>{}(key);
-        unsigned int bucket = (k & m_sz_m1) << 4;
+        unsigned int bucket = (unhash(k) & m_sz_m1) << 4;
         for(auto b = 0; b < 16; ++b)
         {
             if(m_location[bucket + b] == 0) {
@@ -451,25 +1355,409 @@ public:
                 return;
             }
         }
+        overflow((k >> 32) | 1, V());
+    }
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        return find_int64_in(key, bucket_of(key));
+    }
+
+    // find_int64 for callers that already hashed key, e.g. 8 at a time with the
+    // vector H: b must be bucket_of(key).
+    inline __attribute__((always_inline)) V * find_int64_in(const uint64_t & key, uint64_t b) {
+        const auto kk = _mm512_set1_epi64(key);
+        const unsigned int bucket = b << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        unsigned short masklo = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ);
+        unsigned short maskhi = _mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ);
+        masklo |= (maskhi << 8);
+        FASH_STAT(++m_probes.lookups; m_probes.lines += 2);
+
+        if(masklo == 0)
+            return m_location[bucket + 15] ? m_stash.find(key) : nullptr;
+
+        FASH_STAT(++m_probes.hits; ++m_probes.lines; ++m_probes.distance[(__builtin_ffs(masklo) - 1) >> 3]);
+        return m_data + __builtin_ffs(masklo) - 1 + bucket;
+    }
+
+    // erase never leaves a tombstone behind. fash probes scan the whole 16 slot
+    // bucket rather than stopping at the first empty slot, so a hole can't hide
+    // a key; the bucket's last live entry is moved into it anyway so live keys
+    // stay packed at the front, where at_int64 finds them in the first line and
+    // at_no_intrinsic_int64 in as many compares as the bucket has keys.
+    bool erase_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        const auto kk = _mm512_set1_epi64(key);
+        const unsigned int bucket = (k & m_sz_m1) << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        unsigned int hit = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ) | (_mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ) << 8);
+
+        if(hit == 0)
+            return m_location[bucket + 15] && m_stash.erase(key);
+
+        unsigned int live = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_NE) | (_mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_NE) << 8);
+        const auto slot = bucket + __builtin_ctz(hit);
+        const auto last = bucket + 31 - __builtin_clz(live);
+        m_location[slot] = m_location[last];
+        m_data[slot] = m_data[last];
+        m_location[last] = 0;
+
+        // a stashed key of this bucket takes the freed slot, so stashed keys
+        // only ever belong to full buckets.
+        if(last == bucket + 15 && m_stash.size())
+            unstash(bucket >> 4);
+        return true;
     }
 
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto k = unhash(key);
+        const unsigned int bucket = (k & m_sz_m1) << 4;
+        for(auto b = 0; b < 16; ++b)
+        {
+            if(m_location[bucket + b] == 0) {
+                m_location[bucket + b] = key;
+                m_data[bucket + b] = data;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << 4;
+        for(int i = 0; i < 16; ++i) {
+            if(m_location[bucket + i]) {
+                f(m_location[bucket + i], m_data[bucket + i]);
+                m_location[bucket + i] = 0;
+            }
+        }
+
+        if(m_stash.size())
+            m_stash.drain_if([this, b](const uint64_t & key) { return bucket_of(key) == b; }, f);
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+
+    // pulls both lines of bucket b towards the cache, for callers that hash
+    // ahead of their lookups.
+    inline __attribute__((always_inline)) void prefetch_bucket(uint64_t b) const {
+        __builtin_prefetch(m_location + (b << 4));
+        __builtin_prefetch(m_location + (b << 4) + 8);
+    }
+
+    inline __attribute__((always_inline)) void prefetch_int64(const uint64_t & key) const {
+        prefetch_bucket(bucket_of(key));
+    }
+
+    // walks the buckets, then the stash.
+    using iterator = fash_iterator<V>;
+    iterator begin() { return iterator(m_location, m_data, m_sz, m_stash.keys(), m_stash.values(), m_stash.size()); }
+    iterator end() { return iterator(); }
+
+    // as fash128x::count_live/export_to. stashed entries count towards the
+    // range their bucket is in and are written after the bucket entries.
+    uint64_t count_live(uint64_t first = 0, uint64_t last = ~0ULL) const {
+        last = std::min(last, bucket_count());
+        if(first >= last)
+            return 0;
+        uint64_t n = fash_count_slots(m_location, first << 4, last << 4);
+        for(uint64_t i = 0; i < m_stash.size(); ++i)
+            n += bucket_of(m_stash.keys()[i]) - first < last - first;
+        return n;
+    }
+
+    uint64_t export_to(uint64_t* keys, V* values, uint64_t first = 0, uint64_t last = ~0ULL) const {
+        last = std::min(last, bucket_count());
+        if(first >= last)
+            return 0;
+        uint64_t n = fash_compress_slots(m_location, m_data, first << 4, last << 4, keys, values);
+        for(uint64_t i = 0; i < m_stash.size(); ++i) {
+            if(bucket_of(m_stash.keys()[i]) - first < last - first) {
+                keys[n] = m_stash.keys()[i];
+                values[n++] = m_stash.values()[i];
+            }
+        }
+        return n;
+    }
+
+    // keys that found their bucket full: currently stashed, stash slots
+    // allocated, and total inserts that have ever overflowed.
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t stash_capacity() const { return m_stash.capacity(); }
+    uint64_t overflow_count() const { return m_overflows; }
+
+#ifdef FASH_STATS
+    // occupancy is counted now, by walking every bucket; the probe counters
+    // cover every lookup since construction or the last reset_probes().
+    fash_stats stats() const {
+        fash_stats s;
+        s.slots = m_sz;
+        s.buckets = m_sz_m1 + 1;
+        s.fill.assign(17, 0);
+        for(uint64_t b = 0; b < s.buckets; ++b) {
+            unsigned int n = 0;
+            for(int i = 0; i < 16; ++i)
+                n += m_location[b * 16 + i] != 0;
+            ++s.fill[n];
+            s.keys += n;
+        }
+        s.stashed = m_stash.size();
+        s.keys += s.stashed;
+        s.overflows = m_overflows;
+        s.probes = m_probes;
+        return s;
+    }
+
+    void reset_probes() { m_probes = {}; }
+#endif
+
     inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
-        x = (x ^ (x >> 31) ^ (x >> 62)) * UINT64_C(0x319642b2d24d8ec3);
-        x = (x ^ (x >> 27) ^ (x >> 54)) * UINT64_C(0x96de1b173f119089);
-        x = x ^ (x >> 30) ^ (x >> 60);
-        return x;
+        return H{}(x);
     }
 
     inline __attribute__((always_inline)) __m512i unhash(__m512i x) const {
-        auto a = _mm512_srli_epi64(x, 31);
-        auto b = _mm512_srli_epi64(x, 62);
-        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), m_a);
-        a = _mm512_srli_epi64(x, 27);
-        b = _mm512_srli_epi64(x, 54);
-        x = _mm512_mullox_epi64(_mm512_xor_epi64(x, _mm512_xor_epi64(a, b)), m_b);
-        a = _mm512_srli_epi64(x, 30);
-        b = _mm512_srli_epi64(x, 60);
-        return _mm512_xor_epi64(x, _mm512_xor_epi64(a, b));
+        return H{}(x);
+    }
+
+private:
+    // keys ahead of the vector being inserted whose buckets get prefetched.
+    static constexpr size_t batch_lookahead = 32;
+
+    void overflow(const uint64_t & key, V data) {
+        m_stash.push(key, data);
+        ++m_overflows;
+    }
+
+    void unstash(uint64_t b) {
+        bool moved = false;
+        m_stash.drain_if([this, b, &moved](const uint64_t & key) { return !moved && bucket_of(key) == b; },
+                         [this, b, &moved](const uint64_t & key, V & value) {
+                             m_location[(b << 4) + 15] = key;
+                             m_data[(b << 4) + 15] = value;
+                             moved = true;
+                         });
+    }
+};
+
+// value-less tables: fash<K, Empty> (a.k.a. fash_set<K>) keeps fash's 16 slot
+// buckets of 64-bit keys and the overflow stash, and allocates no value array
+// at all, which halves the footprint of fash<K, uint64_t>.
+struct Empty {};
+
+template <class K, class H, class A>
+class fash<K, Empty, H, A> {
+    uint64_t* __restrict m_location;
+    unsigned char m_bitsz;
+    unsigned int m_sz, m_sz_m1;
+    const __m512i zero = _mm512_set1_epi64(0ULL);
+    fash_stash<Empty> m_stash;
+    uint64_t m_overflows = 0;
+
+public: 
+    using key_type = K;
+    using value_type = Empty;
+
+    fash(unsigned char bit_size) {
+        m_bitsz = bit_size;
+        m_sz = 1 << (m_bitsz + 4);
+        m_sz_m1 = (1<<m_bitsz) - 1;
+        m_location = fash_zalloc<uint64_t, A>(m_sz);
+    }
+
+    ~fash() {
+        fash_free<uint64_t, A>(m_location, m_sz);
+    }
+
+    fash(const fash &) = delete;
+    fash & operator=(const fash &) = delete;
+
+    inline __attribute__((always_inline)) bool contains_int64(const uint64_t & key) const {
+        const unsigned int bucket = (unhash(key) & m_sz_m1) << 4;
+        if(match(key, bucket))
+            return true;
+        return m_location[bucket + 15] && m_stash.contains(key);
+    }
+
+    // false if the key was already there.
+    bool insert_int64(const uint64_t & key) {
+        const unsigned int bucket = (unhash(key) & m_sz_m1) << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        const auto kk = _mm512_set1_epi64(key);
+        unsigned int hit = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ) | (_mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ) << 8);
+        unsigned int open = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_EQ) | (_mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_EQ) << 8);
+
+        if(hit)
+            return false;
+
+        if(open == 0) {
+            if(m_stash.contains(key))
+                return false;
+            m_stash.push(key, Empty());
+            ++m_overflows;
+            return true;
+        }
+
+        m_location[bucket + __builtin_ctz(open)] = key;
+        return true;
+    }
+
+    // same compaction as fash::erase_int64.
+    bool erase_int64(const uint64_t & key) {
+        const unsigned int bucket = (unhash(key) & m_sz_m1) << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        const auto kk = _mm512_set1_epi64(key);
+        unsigned int hit = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ) | (_mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ) << 8);
+
+        if(hit == 0)
+            return m_location[bucket + 15] && m_stash.erase(key);
+
+        unsigned int live = _mm512_cmp_epi64_mask(zero, blo, _MM_CMPINT_NE) | (_mm512_cmp_epi64_mask(zero, bhi, _MM_CMPINT_NE) << 8);
+        const auto last = bucket + 31 - __builtin_clz(live);
+        m_location[bucket + __builtin_ctz(hit)] = m_location[last];
+        m_location[last] = 0;
+
+        if(last == bucket + 15 && m_stash.size()) {
+            bool moved = false;
+            m_stash.drain_if([this, bucket, &moved](const uint64_t & k) { return !moved && ((unhash(k) & m_sz_m1) << 4) == bucket; },
+                             [this, bucket, &moved](const uint64_t & k, Empty &) {
+                                 m_location[bucket + 15] = k;
+                                 moved = true;
+                             });
+        }
+        return true;
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t overflow_count() const { return m_overflows; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+
+private:
+    inline __attribute__((always_inline)) bool match(const uint64_t & key, unsigned int bucket) const {
+        const auto kk = _mm512_set1_epi64(key);
+        if(_mm512_cmp_epi64_mask(kk, _mm512_load_epi64(m_location + bucket), _MM_CMPINT_EQ))
+            return true;
+        return _mm512_cmp_epi64_mask(kk, _mm512_load_epi64(m_location + bucket + 8), _MM_CMPINT_EQ);
+    }
+};
+
+template <class K, class H = fash_mix_hash, class A = fash_small_pages>
+using fash_set = fash<K, Empty, H, A>;
+
+// fash32: the 16 slot buckets the header comment describes, with 32-bit keys.
+// a whole bucket is one 64-byte line, checked with a single
+// _mm512_cmpeq_epi32_mask, where the 64-bit tables need two loads and two
+// compares. values sit in a parallel array as in fash. keys must fit in 32
+// bits and 0 is reserved; keys that find their bucket full go to a stash.
+template <class V, class H = fash_mix_hash>
+class fash32 {
+    uint32_t* __restrict m_location;
+    V* __restrict m_data;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    fash_stash<V> m_stash;
+    uint64_t m_overflows = 0;
+
+public: 
+    using key_type = uint32_t;
+    using value_type = V;
+
+    fash32(unsigned char bit_size) {
+        m_bitsz = bit_size;
+        m_sz = 1ULL << (m_bitsz + 4);
+        m_sz_m1 = (1ULL << m_bitsz) - 1;
+        m_location = fash_zalloc<uint32_t>(m_sz);
+        m_data = fash_zalloc<V>(m_sz);
+    }
+
+    ~fash32() {
+        fash_free(m_location, m_sz);
+        fash_free(m_data, m_sz);
+    }
+
+    fash32(const fash32 &) = delete;
+    fash32 & operator=(const fash32 &) = delete;
+
+    inline __attribute__((always_inline)) V * find_int32(const uint32_t & key) {
+        const uint64_t bucket = (unhash(key) & m_sz_m1) << 4;
+        const auto b = _mm512_load_si512(m_location + bucket);
+        unsigned short mask = _mm512_cmpeq_epi32_mask(_mm512_set1_epi32(key), b);
+
+        if(mask)
+            return m_data + bucket + __builtin_ctz(mask);
+
+        return m_location[bucket + 15] ? m_stash.find(key) : nullptr;
+    }
+
+    inline __attribute__((always_inline)) V & at_int32(const uint32_t & key) {
+        auto found = find_int32(key);
+        if(!found)
+            throw;
+        return *found;
+    }
+
+    void insert_int32(const uint32_t & key, V data) {
+        const uint64_t bucket = (unhash(key) & m_sz_m1) << 4;
+        const auto b = _mm512_load_si512(m_location + bucket);
+        unsigned short open = _mm512_cmpeq_epi32_mask(_mm512_setzero_si512(), b);
+
+        if(open == 0) {
+            m_stash.push(key, data);
+            ++m_overflows;
+            return;
+        }
+
+        const auto idx = bucket + __builtin_ctz(open);
+        m_location[idx] = key;
+        m_data[idx] = data;
+    }
+
+    // same compaction as fash::erase_int64, in one line instead of two.
+    bool erase_int32(const uint32_t & key) {
+        const uint64_t bucket = (unhash(key) & m_sz_m1) << 4;
+        const auto b = _mm512_load_si512(m_location + bucket);
+        unsigned short hit = _mm512_cmpeq_epi32_mask(_mm512_set1_epi32(key), b);
+
+        if(hit == 0)
+            return m_location[bucket + 15] && m_stash.erase(key);
+
+        unsigned short live = _mm512_cmpneq_epi32_mask(_mm512_setzero_si512(), b);
+        const auto slot = bucket + __builtin_ctz(hit);
+        const auto last = bucket + 31 - __builtin_clz(live);
+        m_location[slot] = m_location[last];
+        m_data[slot] = m_data[last];
+        m_location[last] = 0;
+
+        if(last == bucket + 15 && m_stash.size()) {
+            bool moved = false;
+            m_stash.drain_if([this, bucket, &moved](const uint64_t & k) { return !moved && ((unhash(k) & m_sz_m1) << 4) == bucket; },
+                             [this, bucket, &moved](const uint64_t & k, V & v) {
+                                 m_location[bucket + 15] = k;
+                                 m_data[bucket + 15] = v;
+                                 moved = true;
+                             });
+        }
+        return true;
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t overflow_count() const { return m_overflows; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
     }
 };
 
@@ -479,7 +1767,7 @@ struct fash_kvp {
     T value;
 };
 
-template <class K, class V>
+template <class K, class V, class H = fash_mix_hash>
 class fash2 {
     fash_kvp<V>* __restrict m_data;
     unsigned char m_bitsz;
@@ -487,21 +1775,23 @@ class fash2 {
     __m512i m_vz_m1;
     const __m512i zero = _mm512_set1_epi64(0ULL);
     const __m512i one = _mm512_set1_epi64(1ULL);
-    const __m512i m_a = _mm512_set1_epi64(UINT64_C(0x319642b2d24d8ec3));
-    const __m512i m_b = _mm512_set1_epi64(UINT64_C(0x96de1b173f119089));
+    fash_stash<V> m_stash;
+    uint64_t m_overflows = 0;
 
 public: 
+    using key_type = K;
+    using value_type = V;
+
     fash2(unsigned char bit_size) {
         m_bitsz = bit_size;
         m_sz = 1 << (m_bitsz + 4);
         m_sz_m1 = (1<<m_bitsz) - 1;
         m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
-        m_data = new (std::align_val_t(64)) fash_kvp<V>[m_sz];
-        memset(m_data, 0, m_sz*sizeof(fash_kvp<V>));
+        m_data = fash_zalloc<fash_kvp<V>>(m_sz);
     }
 
     ~fash2() {
-        ::operator delete[] (m_data, std::align_val_t(64));
+        fash_free(m_data, m_sz);
     }
 
     inline __attribute__((always_inline))  V& at_no_intrinsic_int64(const uint64_t & key) {
@@ -512,6 +1802,12 @@ public:
                 return m_data[bucket + i].value;
         }
 
+        if(m_data[bucket + 15].key) {
+            auto stashed = m_stash.find(key);
+            if(stashed)
+                return *stashed;
+        }
+
         throw;
     }
 
@@ -526,7 +1822,7 @@ public:
                 return;
             }
         }
-        throw;
+        overflow(key, data);
     }
 
     void insert_no_intrinsic_int64(const uint64_t & key) {
@@ -539,20 +1835,71 @@ public:
                 return;
             }
         }
-        throw;
+        overflow(key, V());
     }
 
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        const unsigned int bucket = (k & m_sz_m1) << 4;
+        for(int i = 0; i < 16; ++i) {
+            if(key == m_data[bucket + i].key)
+                return &m_data[bucket + i].value;
+        }
+
+        return m_data[bucket + 15].key ? m_stash.find(key) : nullptr;
+    }
+
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto k = unhash(key);
+        const unsigned int bucket = (k & m_sz_m1) << 4;
+        for(auto b = 0; b < 16; ++b)
+        {
+            if(m_data[bucket + b].key == 0) {
+                m_data[bucket + b].key = key;
+                m_data[bucket + b].value = data;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << 4;
+        for(int i = 0; i < 16; ++i) {
+            if(m_data[bucket + i].key) {
+                f(m_data[bucket + i].key, m_data[bucket + i].value);
+                m_data[bucket + i].key = 0;
+            }
+        }
+
+        if(m_stash.size())
+            m_stash.drain_if([this, b](const uint64_t & key) { return bucket_of(key) == b; }, f);
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t stash_capacity() const { return m_stash.capacity(); }
+    uint64_t overflow_count() const { return m_overflows; }
+
     inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
-        x = (x ^ (x >> 31) ^ (x >> 62)) * UINT64_C(0x319642b2d24d8ec3);
-        x = (x ^ (x >> 27) ^ (x >> 54)) * UINT64_C(0x96de1b173f119089);
-        x = x ^ (x >> 30) ^ (x >> 60);
-        return x;
+        return H{}(x);
     }
 
+private:
+    void overflow(const uint64_t & key, V data) {
+        m_stash.push(key, data);
+        ++m_overflows;
+    }
 };
 
 
-template <class K, class V>
+template <class K, class V, class H = fash_mix_hash>
 class fash128x2 {
     fash_kvp<V> * __restrict m_data;
     unsigned char m_bitsz;
@@ -560,21 +1907,53 @@ class fash128x2 {
     __m512i m_vz_m1;
     const __m512i zero = _mm512_set1_epi64(0ULL);
     const __m512i one = _mm512_set1_epi64(1ULL);
-    const __m512i m_a = _mm512_set1_epi64(UINT64_C(0x319642b2d24d8ec3));
-    const __m512i m_b = _mm512_set1_epi64(UINT64_C(0x96de1b173f119089));
 
 public: 
+    using key_type = K;
+    using value_type = V;
+
     fash128x2(unsigned char bit_size) {
         m_bitsz = bit_size;
         m_sz = 1 << (m_bitsz + 1); // 7 - 6 = (bucket size) - (fraction of entries)
         m_sz_m1 = (1<<(m_bitsz-6)) - 1;
         m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
-        m_data = new (std::align_val_t(64)) fash_kvp<V>[m_sz];
-        memset(m_data, 0, m_sz*sizeof(fash_kvp<V>));
+        m_data = fash_zalloc<fash_kvp<V>>(m_sz);
     }
 
     ~fash128x2() {
-        ::operator delete[] (m_data, std::align_val_t(64));
+        fash_free(m_data, m_sz);
+    }
+
+    // same software pipeline as fash128x::at_batch: 8 keys hashed per vector,
+    // their start slots prefetched `distance` keys ahead of the one resolved.
+    size_t at_batch(const uint64_t* keys, size_t n, V* out, unsigned char* found = nullptr, unsigned int distance = 32) {
+        uint64_t ring[batch_ring];
+        distance = std::min((distance + 7) & ~7u, batch_ring - 8);
+        size_t misses = 0;
+        size_t staged = 0;
+
+        for(; staged < n && staged < distance; staged += 8)
+            batch_stage(keys, n, staged, ring);
+
+        for(size_t i = 0; i < n; i += 8) {
+            if(staged < n) {
+                batch_stage(keys, n, staged, ring);
+                staged += 8;
+            }
+
+            const size_t end = std::min(i + 8, n);
+            for(size_t j = i; j < end; ++j) {
+                V* hit = probe_from(keys[j], ring[j & (batch_ring - 1)]);
+                if(hit)
+                    out[j] = *hit;
+                else
+                    ++misses;
+                if(found)
+                    found[j] = hit != nullptr;
+            }
+        }
+
+        return misses;
     }
 
     inline __attribute__((always_inline)) V & at_no_intrinsic_int64(const uint64_t & key) {
@@ -626,12 +2005,373 @@ public:
         throw;
     }
 
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        return probe_from(key, ((k & m_sz_m1) << 7) + ((18302628885633695744ULL & k)>>57));
+    }
+
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto k = unhash(key);
+        const unsigned int bucket = (k & m_sz_m1) << 7;
+        const unsigned int guess = (18302628885633695744ULL & k)>>57;
+
+        for(int i = 0; i < 128; ++i)
+        {
+            auto idx = bucket + ((i + guess) & 127);
+            if(m_data[idx].key == 0) {
+                m_data[idx].key = key;
+                m_data[idx].value = data;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << 7;
+        for(int i = 0; i < 128; ++i) {
+            if(m_data[bucket + i].key) {
+                f(m_data[bucket + i].key, m_data[bucket + i].value);
+                m_data[bucket + i].key = 0;
+            }
+        }
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+
     inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
-        x = (x ^ (x >> 31) ^ (x >> 62)) * UINT64_C(0x319642b2d24d8ec3);
-        x = (x ^ (x >> 27) ^ (x >> 54)) * UINT64_C(0x96de1b173f119089);
-        x = x ^ (x >> 30) ^ (x >> 60);
-        return x;
+        return H{}(x);
+    }
+
+    inline __attribute__((always_inline)) __m512i unhash(__m512i x) const {
+        return H{}(x);
+    }
+
+private:
+    static constexpr unsigned int batch_ring = 256;
+
+    // idx is the bucket base plus the guessed start slot.
+    inline __attribute__((always_inline)) V * probe_from(const uint64_t & key, uint64_t idx) {
+        const uint64_t bucket = idx & ~127ULL;
+        const unsigned int guess = idx & 127;
+        for(int i = 0; i < 128; ++i)
+        {
+            auto slot = bucket + ((i + guess) & 127);
+            if(m_data[slot].key == key) 
+                return &m_data[slot].value;
+        }
+
+        return nullptr;
     }
 
+    inline __attribute__((always_inline)) void batch_stage(const uint64_t* keys, size_t n, size_t j, uint64_t* ring) {
+        const __mmask8 live = n - j >= 8 ? 0xFF : (1 << (n - j)) - 1;
+        const auto k = unhash(_mm512_maskz_loadu_epi64(live, keys + j));
+        const auto bucket = _mm512_slli_epi64(_mm512_and_epi64(k, m_vz_m1), 7);
+        uint64_t* idx = ring + (j & (batch_ring - 1));
+        _mm512_storeu_epi64(idx, _mm512_add_epi64(bucket, _mm512_srli_epi64(k, 57)));
+
+        for(int l = 0; l < 8; ++l)
+            __builtin_prefetch(m_data + idx[l]);
+    }
+};
+
+// fash128xt: fash128x's 128 slot buckets plus a one byte tag per slot. a tag is
+// 0x80 | 7 bits of the key's hash (bits the bucket index doesn't use), and 0
+// marks an empty slot. the 128 tags of a bucket are two cache lines, so a probe
+// is two _mm512_cmpeq_epi8_mask compares covering 64 slots each, and full keys
+// are only read for tag matches: ~half a false positive per miss at the
+// nominal 50% fill, instead of up to 16 lines of keys. keys whose bucket is
+// full go to a fash_stash, as in fash, via insert_int64; try_insert_int64
+// refuses them instead, which is what fash_growable wants.
+template <class K, class V, class H = fash_mix_hash>
+class fash128xt {
+    uint64_t* __restrict m_location;
+    V* __restrict m_data;
+    uint8_t* __restrict m_tag;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    fash_stash<V> m_stash;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    fash128xt(unsigned char bit_size) {
+        m_bitsz = bit_size;
+        m_sz = 1ULL << (m_bitsz + 1);
+        m_sz_m1 = (1ULL<<(m_bitsz-6)) - 1;
+        m_location = fash_zalloc<uint64_t>(m_sz);
+        m_data = fash_zalloc<V>(m_sz);
+        m_tag = fash_zalloc<uint8_t>(m_sz);
+    }
+
+    ~fash128xt() {
+        fash_free(m_location, m_sz);
+        fash_free(m_data, m_sz);
+        fash_free(m_tag, m_sz);
+    }
+
+    fash128xt(const fash128xt &) = delete;
+    fash128xt & operator=(const fash128xt &) = delete;
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        const uint64_t bucket = (k & m_sz_m1) << 7;
+        const auto tt = _mm512_set1_epi8(tag(k));
+        uint64_t m0 = _mm512_cmpeq_epi8_mask(tt, _mm512_load_si512(m_tag + bucket));
+        uint64_t m1 = _mm512_cmpeq_epi8_mask(tt, _mm512_load_si512(m_tag + bucket + 64));
+
+        for(; m0; m0 &= m0 - 1) {
+            const auto idx = bucket + __builtin_ctzll(m0);
+            if(m_location[idx] == key)
+                return m_data + idx;
+        }
+
+        for(; m1; m1 &= m1 - 1) {
+            const auto idx = bucket + 64 + __builtin_ctzll(m1);
+            if(m_location[idx] == key)
+                return m_data + idx;
+        }
+
+        // slots fill front to back and only empty a whole bucket at a time, so
+        // the last tag is set exactly when the bucket is full.
+        return m_tag[bucket + 127] ? m_stash.find(key) : nullptr;
+    }
+
+    inline __attribute__((always_inline)) V & at_int64(const uint64_t & key) {
+        V* found = find_int64(key);
+        if(!found)
+            throw std::out_of_range("fash128xt::at_int64");
+        return *found;
+    }
+
+    // try_insert_int64, with the stash taking keys whose bucket is full.
+    void insert_int64(const uint64_t & key, V data) {
+        if(!try_insert_int64(key, data))
+            m_stash.push(key, data);
+    }
+
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto k = unhash(key);
+        const uint64_t bucket = (k & m_sz_m1) << 7;
+        const auto z = _mm512_setzero_si512();
+        uint64_t m0 = _mm512_cmpeq_epi8_mask(z, _mm512_load_si512(m_tag + bucket));
+        uint64_t m1 = _mm512_cmpeq_epi8_mask(z, _mm512_load_si512(m_tag + bucket + 64));
+
+        uint64_t idx;
+        if(m0)
+            idx = bucket + __builtin_ctzll(m0);
+        else if(m1)
+            idx = bucket + 64 + __builtin_ctzll(m1);
+        else
+            return false;
+
+        m_location[idx] = key;
+        m_data[idx] = data;
+        m_tag[idx] = tag(k);
+        return true;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << 7;
+        for(int i = 0; i < 128; ++i) {
+            if(m_tag[bucket + i]) {
+                f(m_location[bucket + i], m_data[bucket + i]);
+                m_location[bucket + i] = 0;
+                m_tag[bucket + i] = 0;
+            }
+        }
+
+        if(m_stash.size())
+            m_stash.drain_if([this, b](const uint64_t & key) { return bucket_of(key) == b; }, f);
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+    uint64_t stash_size() const { return m_stash.size(); }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+
+private:
+    static inline __attribute__((always_inline)) char tag(uint64_t k) {
+        return static_cast<char>(0x80 | ((k >> 50) & 0x7F));
+    }
 };
 
+// fash_growable wraps any of the fixed size tables above (fash, fash2, fash128x,
+// fash128x2, fash128xt) so the key universe doesn't have to be known up front.
+// once the table holds max_load * nominal_size() keys, or a bucket fills up, a
+// table with one more bit is allocated and the old one is drained `step`
+// buckets at a time on every following insert and lookup. the old table is
+// guaranteed to be empty before the new one reaches its own threshold, so at
+// most two tables are alive at once and no single call pays for the whole
+// rehash. step == 0 drains everything at once, which is the stop-the-world
+// behavior to compare against.
+template <class T>
+class fash_growable {
+    using V = typename T::value_type;
+    T* m_table;
+    T* m_old;
+    uint64_t m_cursor;   // buckets of m_old below this have already been migrated
+    uint64_t m_count, m_limit;
+    double m_max_load;
+    unsigned int m_step;
+
+public:
+    fash_growable(unsigned char bit_size, double max_load = 1.0, unsigned int step = 1) {
+        m_table = new T(bit_size);
+        m_old = nullptr;
+        m_cursor = 0;
+        m_count = 0;
+        m_max_load = max_load;
+        m_step = step;
+        m_limit = m_max_load * m_table->nominal_size();
+    }
+
+    // takes over table, which holds count keys and has outgrown itself (say a
+    // fash whose stash has started to fill), and starts growing out of it.
+    fash_growable(T* table, uint64_t count, double max_load = 1.0, unsigned int step = 1) {
+        m_table = table;
+        m_old = nullptr;
+        m_cursor = 0;
+        m_count = count;
+        m_max_load = max_load;
+        m_step = step;
+        grow();
+    }
+
+    ~fash_growable() {
+        delete m_table;
+        delete m_old;
+    }
+
+    fash_growable(const fash_growable &) = delete;
+    fash_growable & operator=(const fash_growable &) = delete;
+
+    void insert_int64(const uint64_t & key, V data) {
+        if(m_old)
+            migrate(m_step);
+
+        if(m_count >= m_limit)
+            grow();
+
+        while(!m_table->try_insert_int64(key, data))
+            grow();
+
+        ++m_count;
+    }
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        if(m_old) [[unlikely]] {
+            migrate(m_step);
+            if(m_old && m_old->bucket_of(key) >= m_cursor) {
+                auto found = m_old->find_int64(key);
+                if(found)
+                    return found;
+            }
+        }
+
+        return m_table->find_int64(key);
+    }
+
+    bool erase_int64(const uint64_t & key) {
+        if(m_old) {
+            migrate(m_step);
+            if(m_old && m_old->bucket_of(key) >= m_cursor && m_old->erase_int64(key)) {
+                --m_count;
+                return true;
+            }
+        }
+
+        if(!m_table->erase_int64(key))
+            return false;
+
+        --m_count;
+        return true;
+    }
+
+    // drains whatever is left of the old table right now.
+    void finish_growth() {
+        if(m_old)
+            migrate(m_old->bucket_count());
+    }
+
+    bool growing() const { return m_old != nullptr; }
+    uint64_t size() const { return m_count; }
+    unsigned char bit_size() const { return m_table->bit_size(); }
+
+private:
+    void grow() {
+        finish_growth();
+        m_old = m_table;
+        m_table = new T(m_old->bit_size() + 1);
+        m_cursor = 0;
+        m_limit = m_max_load * m_table->nominal_size();
+
+        if(m_step == 0)
+            finish_growth();
+    }
+
+    // entries that don't fit are set aside until the bucket is fully drained:
+    // drain_bucket walks m_old's stash, which rebuild drains too, so rebuilding
+    // from inside the callback would pull entries out from under the walk.
+    void migrate(uint64_t buckets) {
+        const uint64_t end = std::min(m_cursor + buckets, m_old->bucket_count());
+        std::vector<std::pair<uint64_t, V>> overflow;
+        for(; m_cursor < end; ++m_cursor) {
+            m_old->drain_bucket(m_cursor, [this, &overflow](const uint64_t & key, V & value) {
+                if(!m_table->try_insert_int64(key, value))
+                    overflow.emplace_back(key, value);
+            });
+            if(!overflow.empty()) [[unlikely]] {
+                rebuild(overflow);
+                overflow.clear();
+            }
+        }
+
+        if(m_cursor == m_old->bucket_count()) {
+            delete m_old;
+            m_old = nullptr;
+        }
+    }
+
+    // a bucket of the new table overflowed mid-migration, leaving live behind.
+    // this is the one path that pauses: everything still live moves into a
+    // table with another bit.
+    void rebuild(std::vector<std::pair<uint64_t, V>> & live) {
+        auto collect = [&live](const uint64_t & k, V & v) { live.emplace_back(k, v); };
+        for(uint64_t b = 0; b < m_table->bucket_count(); ++b)
+            m_table->drain_bucket(b, collect);
+        for(uint64_t b = m_cursor + 1; b < m_old->bucket_count(); ++b)
+            m_old->drain_bucket(b, collect);
+
+        unsigned char bits = m_table->bit_size();
+        bool placed = false;
+        while(!placed) {
+            delete m_table;
+            m_table = new T(++bits);
+            placed = true;
+            for(auto & [k, v] : live) {
+                if(!m_table->try_insert_int64(k, v)) {
+                    placed = false;
+                    break;
+                }
+            }
+        }
+
+        m_cursor = m_old->bucket_count() - 1;
+        m_limit = m_max_load * m_table->nominal_size();
+    }
+};
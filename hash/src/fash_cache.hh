@@ -0,0 +1,172 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "fash.hh"
+
+// fash_cache: a fixed size cache on fash's bucket layout (16 slots of 64-bit
+// keys per bucket, values in a parallel array) with CLOCK eviction inside each
+// bucket. every bucket has a 16-bit reference mask, one bit per slot, and a
+// clock hand. a hit ors its compare mask into the reference mask, so marking
+// an entry costs no more than finding it. a miss in a full bucket evicts the
+// first slot from the hand onward whose bit is clear, clearing the bits it
+// passes over (their second chance); if every bit is set they are all cleared
+// and the hand's slot goes.
+//
+// eviction never leaves the bucket, so the cache holds exactly 16 * 2^bit_size
+// entries once warm and never allocates after construction. new entries start
+// with a clear bit, so a key seen once is the first to go.
+//
+// key 0 marks an empty slot: get_int64(0) is a miss and get_or_compute(0)
+// (and so put_int64(0)) throws std::invalid_argument.
+template <class K, class V, class H = fash_mix_hash>
+class fash_cache {
+    uint64_t* __restrict m_location;
+    V* __restrict m_data;
+    unsigned short* __restrict m_ref;
+    unsigned char* __restrict m_hand;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    uint64_t m_hits = 0, m_misses = 0, m_evictions = 0;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    fash_cache(unsigned char bit_size) {
+        m_bitsz = bit_size;
+        m_sz = 1ULL << (m_bitsz + 4);
+        m_sz_m1 = (1ULL << m_bitsz) - 1;
+        m_location = fash_zalloc<uint64_t>(m_sz);
+        m_data = fash_zalloc<V>(m_sz);
+        m_ref = fash_zalloc<unsigned short>(m_sz_m1 + 1);
+        m_hand = fash_zalloc<unsigned char>(m_sz_m1 + 1);
+    }
+
+    ~fash_cache() {
+        fash_free(m_location, m_sz);
+        fash_free(m_data, m_sz);
+        fash_free(m_ref, m_sz_m1 + 1);
+        fash_free(m_hand, m_sz_m1 + 1);
+    }
+
+    fash_cache(const fash_cache &) = delete;
+    fash_cache & operator=(const fash_cache &) = delete;
+
+    // the cached value, marked as recently used, or nullptr.
+    inline __attribute__((always_inline)) V * get_int64(const uint64_t & key) {
+        if(key == 0) [[unlikely]] {
+            ++m_misses;
+            return nullptr;
+        }
+        const uint64_t b = unhash(key) & m_sz_m1;
+        const unsigned int hit = match(key, b << 4);
+        if(!hit) {
+            ++m_misses;
+            return nullptr;
+        }
+
+        ++m_hits;
+        m_ref[b] |= hit;
+        return m_data + (b << 4) + __builtin_ctz(hit);
+    }
+
+    // the cached value if there is one, otherwise compute(key), stored (evicting
+    // if the bucket is full) and returned. the reference stays valid until the
+    // next insert into the same bucket. compute runs before anything is stored,
+    // so if it throws the cache is unchanged, and it may use the cache itself:
+    // the bucket is looked at again once it returns.
+    template <class F>
+    inline __attribute__((always_inline)) V & get_or_compute(const uint64_t & key, F && compute) {
+        if(key == 0) [[unlikely]]
+            throw std::invalid_argument("fash_cache: key 0 is reserved");
+
+        const uint64_t b = unhash(key) & m_sz_m1;
+        const uint64_t bucket = b << 4;
+        const unsigned int hit = match(key, bucket);
+
+        if(hit) [[likely]] {
+            ++m_hits;
+            m_ref[b] |= hit;
+            return m_data[bucket + __builtin_ctz(hit)];
+        }
+
+        ++m_misses;
+        V value = compute(key);
+
+        // compute may have cached key itself; its value is replaced, as in put.
+        const unsigned int again = match(key, bucket);
+        if(again) [[unlikely]] {
+            m_data[bucket + __builtin_ctz(again)] = std::move(value);
+            return m_data[bucket + __builtin_ctz(again)];
+        }
+
+        const unsigned int open = match(0, bucket);
+        const auto slot = bucket + (open ? __builtin_ctz(open) : victim(b));
+        m_data[slot] = std::move(value);
+        m_location[slot] = key;
+        return m_data[slot];
+    }
+
+    // stores key -> data, replacing an existing value or evicting as above.
+    void put_int64(const uint64_t & key, V data) {
+        get_or_compute(key, [&](const uint64_t &) { return data; }) = data;
+    }
+
+    bool erase_int64(const uint64_t & key) {
+        if(key == 0)
+            return false;
+        const uint64_t b = unhash(key) & m_sz_m1;
+        const unsigned int hit = match(key, b << 4);
+        if(!hit)
+            return false;
+
+        m_location[(b << 4) + __builtin_ctz(hit)] = 0;
+        m_ref[b] &= ~hit;
+        return true;
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t capacity() const { return m_sz; }
+    uint64_t hit_count() const { return m_hits; }
+    uint64_t miss_count() const { return m_misses; }
+    uint64_t eviction_count() const { return m_evictions; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+
+private:
+    inline __attribute__((always_inline)) unsigned int match(const uint64_t & key, uint64_t bucket) const {
+        const auto kk = _mm512_set1_epi64(key);
+        return _mm512_cmpeq_epi64_mask(kk, _mm512_load_epi64(m_location + bucket)) |
+               (_mm512_cmpeq_epi64_mask(kk, _mm512_load_epi64(m_location + bucket + 8)) << 8);
+    }
+
+    // the clock sweep over bucket b's reference mask, as bit operations: rotate
+    // the mask so the hand is bit 0, and the first clear bit is the victim.
+    inline unsigned int victim(uint64_t b) {
+        ++m_evictions;
+        const unsigned int hand = m_hand[b];
+        const unsigned int ref = m_ref[b];
+        const unsigned int rot = ((ref >> hand) | (ref << (16 - hand))) & 0xFFFF;
+
+        unsigned int slot;
+        if(rot == 0xFFFF) {
+            m_ref[b] = 0;
+            slot = hand;
+        } else {
+            const unsigned int d = __builtin_ctz(~rot);
+            const unsigned int passed = ((1u << d) - 1) << hand;
+            m_ref[b] = ref & ~(passed | (passed >> 16));
+            slot = (hand + d) & 15;
+        }
+
+        m_ref[b] &= ~(1u << slot);
+        m_hand[b] = (slot + 1) & 15;
+        return slot;
+    }
+};
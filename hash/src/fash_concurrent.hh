@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+#include <immintrin.h>
+
+#include "fash.hh"
+
+// cfash: the fash bucket layout (16 slots of 64-bit keys per bucket, values in
+// a parallel array) shared between any number of reader and writer threads.
+//
+// publication:
+//   - a writer claims an empty slot by CASing its key word from 0 to `busy`,
+//     writes the value, then release-stores the real key over `busy`. readers
+//     only ever match real keys, so they either miss the slot or see the key
+//     after its value is in place. there is no window where a key is visible
+//     next to a half written value.
+//   - values are never overwritten and keys are never removed, which is what
+//     lets readers go without version counters: find_int64 is one pass over the
+//     bucket with no retries and no atomic RMW, i.e. wait-free.
+//   - writers fill a bucket front to back, so two writers racing on the same
+//     key meet at the same slot: the loser sees `busy`, waits for the key to
+//     land and reports the duplicate instead of inserting it twice.
+//
+// readers compare 8 keys per aligned 64-byte load. those loads are plain, so
+// they race with the writers' atomic stores; the scan is x86-only by contract
+// (x86 doesn't tear the aligned 8-byte lanes of such a load) and is only a
+// hint. the key word it matched is then loaded again through atomic_ref with
+// acquire, which pairs with the writer's release store of that key, so the
+// value behind it is complete under the C++ memory model as well.
+//
+// keys 0 and ~0 are reserved: insert_int64 throws std::invalid_argument for
+// them, and std::length_error when the key's bucket is full rather than
+// dropping the row.
+template <class K, class V, class H = fash_mix_hash>
+class cfash {
+    uint64_t* __restrict m_location;
+    V* __restrict m_data;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    static constexpr uint64_t busy = ~0ULL;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    cfash(unsigned char bit_size) {
+        m_bitsz = bit_size;
+        m_sz = 1ULL << (m_bitsz + 4);
+        m_sz_m1 = (1ULL << m_bitsz) - 1;
+        m_location = fash_zalloc<uint64_t>(m_sz);
+        m_data = fash_zalloc<V>(m_sz);
+    }
+
+    ~cfash() {
+        fash_free(m_location, m_sz);
+        fash_free(m_data, m_sz);
+    }
+
+    cfash(const cfash &) = delete;
+    cfash & operator=(const cfash &) = delete;
+
+    inline __attribute__((always_inline)) const V * find_int64(const uint64_t & key) const {
+        const auto k = unhash(key);
+        const auto kk = _mm512_set1_epi64(key);
+        const uint64_t bucket = (k & m_sz_m1) << 4;
+        auto blo = _mm512_load_epi64(m_location + bucket);
+        auto bhi = _mm512_load_epi64(m_location + bucket + 8);
+        unsigned int hit = _mm512_cmp_epi64_mask(kk, blo, _MM_CMPINT_EQ) | (_mm512_cmp_epi64_mask(kk, bhi, _MM_CMPINT_EQ) << 8);
+
+        if(hit == 0)
+            return nullptr;
+
+        // slots are never reused, so the matched word still holds key.
+        const uint64_t slot = bucket + __builtin_ctz(hit);
+        if(std::atomic_ref<uint64_t>(m_location[slot]).load(std::memory_order_acquire) != key)
+            return nullptr;
+        return m_data + slot;
+    }
+
+    // false if the key is already present.
+    bool insert_int64(const uint64_t & key, V data) {
+        if(key == 0 || key == busy) [[unlikely]]
+            throw std::invalid_argument("cfash: keys 0 and ~0 are reserved");
+
+        const auto k = unhash(key);
+        const uint64_t bucket = (k & m_sz_m1) << 4;
+
+        for(int i = 0; i < 16; ++i) {
+            std::atomic_ref<uint64_t> slot(m_location[bucket + i]);
+            uint64_t cur = slot.load(std::memory_order_acquire);
+
+            for(;;) {
+                while(cur == busy) {
+                    _mm_pause();
+                    cur = slot.load(std::memory_order_acquire);
+                }
+
+                if(cur != 0)
+                    break;
+
+                if(slot.compare_exchange_weak(cur, busy, std::memory_order_acquire)) {
+                    m_data[bucket + i] = data;
+                    slot.store(key, std::memory_order_release);
+                    return true;
+                }
+            }
+
+            if(cur == key)
+                return false;
+        }
+
+        throw std::length_error("cfash: bucket full");
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "fash.hh"
+
+// fash_cuckoo: two-choice placement for high load. a key may live in either of
+// two buckets, both picked from its hash, and a bucket is 8 keys: exactly one
+// 64-byte line. a lookup loads both lines before comparing either, so its two
+// misses go out together, and it never reads more than those two lines of keys
+// (plus the value's line on a hit).
+//
+// insert takes the emptier of the two buckets. when both are full it evicts a
+// resident key to that key's other bucket, and so on (a cuckoo walk) for up to
+// max_kicks moves; a key still homeless after that goes to the stash. with 8
+// slot buckets that keeps the stash empty up to ~95% load, where fash sits at
+// 1/16 of its slots and fash128x at 1/2.
+//
+// sizing: bit_size gives 2^bit_size slots, and nominal_size() is the 7/8 of
+// them the table is meant to be filled to. keys are 64-bit, 0 is reserved.
+template <class K, class V, class H = fash_mix_hash>
+class fash_cuckoo {
+    uint64_t* __restrict m_location;
+    V* __restrict m_data;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    fash_stash<V> m_stash;
+    uint64_t m_count = 0;
+    uint64_t m_overflows = 0;
+    uint64_t m_kicks = 0;
+
+    static constexpr unsigned int max_kicks = 500;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    fash_cuckoo(unsigned char bit_size) {
+        m_bitsz = std::max<unsigned char>(bit_size, 4);
+        m_sz = 1ULL << m_bitsz;
+        m_sz_m1 = (m_sz >> 3) - 1;
+        m_location = fash_zalloc<uint64_t>(m_sz);
+        m_data = fash_zalloc<V>(m_sz);
+    }
+
+    ~fash_cuckoo() {
+        fash_free(m_location, m_sz);
+        fash_free(m_data, m_sz);
+    }
+
+    fash_cuckoo(const fash_cuckoo &) = delete;
+    fash_cuckoo & operator=(const fash_cuckoo &) = delete;
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        const uint64_t b1 = first(k) << 3;
+        const uint64_t b2 = second(k) << 3;
+        const auto kk = _mm512_set1_epi64(key);
+        const auto l1 = _mm512_load_epi64(m_location + b1);
+        const auto l2 = _mm512_load_epi64(m_location + b2);
+        unsigned short m1 = _mm512_cmpeq_epi64_mask(kk, l1);
+        unsigned short m2 = _mm512_cmpeq_epi64_mask(kk, l2);
+
+        if(m1)
+            return m_data + b1 + __builtin_ctz(m1);
+        if(m2)
+            return m_data + b2 + __builtin_ctz(m2);
+
+        // a key is only stashed when both its buckets were full.
+        if(m_stash.size() && !_mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), l1) && !_mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), l2))
+            return m_stash.find(key);
+        return nullptr;
+    }
+
+    inline __attribute__((always_inline)) V & at_int64(const uint64_t & key) {
+        auto found = find_int64(key);
+        if(!found)
+            throw std::out_of_range("fash_cuckoo::at_int64");
+        return *found;
+    }
+
+    bool contains_int64(const uint64_t & key) {
+        return find_int64(key) != nullptr;
+    }
+
+    // false (and the stored value untouched) if key is already there.
+    bool insert_int64(const uint64_t & key, V data) {
+        if(find_int64(key))
+            return false;
+
+        ++m_count;
+        const auto k = unhash(key);
+        const uint64_t b1 = first(k);
+        const uint64_t b2 = second(k);
+        const unsigned int o1 = __builtin_popcount(open(b1));
+        const unsigned int o2 = __builtin_popcount(open(b2));
+
+        if(o1 || o2) {
+            place(o1 >= o2 ? b1 : b2, key, data);
+            return true;
+        }
+
+        // both full: walk. the victim slot rotates so the walk doesn't bounce
+        // the same two keys between the same two buckets.
+        uint64_t b = (k >> 63) ? b2 : b1;
+        uint64_t hold = key;
+        V hold_data = data;
+        for(unsigned int kick = 0; kick < max_kicks; ++kick) {
+            const uint64_t slot = (b << 3) + ((m_kicks++ + kick) & 7);
+            std::swap(hold, m_location[slot]);
+            std::swap(hold_data, m_data[slot]);
+
+            const auto hk = unhash(hold);
+            b = first(hk) == b ? second(hk) : first(hk);
+            if(open(b)) {
+                place(b, hold, hold_data);
+                return true;
+            }
+        }
+
+        m_stash.push(hold, hold_data);
+        ++m_overflows;
+        return true;
+    }
+
+    bool erase_int64(const uint64_t & key) {
+        const auto k = unhash(key);
+        const uint64_t b1 = first(k);
+        const uint64_t b2 = second(k);
+        const auto kk = _mm512_set1_epi64(key);
+        unsigned short m1 = _mm512_cmpeq_epi64_mask(kk, _mm512_load_epi64(m_location + (b1 << 3)));
+        unsigned short m2 = _mm512_cmpeq_epi64_mask(kk, _mm512_load_epi64(m_location + (b2 << 3)));
+
+        if(!m1 && !m2) {
+            if(!m_stash.size() || !m_stash.erase(key))
+                return false;
+            --m_count;
+            return true;
+        }
+
+        const uint64_t b = m1 ? b1 : b2;
+        m_location[(b << 3) + __builtin_ctz(m1 ? m1 : m2)] = 0;
+        --m_count;
+        if(m_stash.size())
+            unstash(b);
+        return true;
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return m_sz - (m_sz >> 3); }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t slot_count() const { return m_sz; }
+    uint64_t size() const { return m_count; }
+    double load_factor() const { return double(m_count) / m_sz; }
+
+    // table and stash bytes, i.e. what the keys actually cost.
+    uint64_t bytes() const { return m_sz * (sizeof(uint64_t) + sizeof(V)) + m_stash.capacity() * (sizeof(uint64_t) + sizeof(V)); }
+
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t overflow_count() const { return m_overflows; }
+    uint64_t kick_count() const { return m_kicks; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+
+private:
+    // the two buckets come from the low and high halves of the hash. when they
+    // collide the second one is the neighbour, so every key has two choices.
+    inline __attribute__((always_inline)) uint64_t first(uint64_t k) const {
+        return k & m_sz_m1;
+    }
+
+    inline __attribute__((always_inline)) uint64_t second(uint64_t k) const {
+        const uint64_t b = (k >> 32) & m_sz_m1;
+        return b == first(k) ? b ^ 1 : b;
+    }
+
+    inline __attribute__((always_inline)) unsigned short open(uint64_t b) const {
+        return _mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), _mm512_load_epi64(m_location + (b << 3)));
+    }
+
+    inline __attribute__((always_inline)) void place(uint64_t b, const uint64_t & key, V data) {
+        const uint64_t slot = (b << 3) + __builtin_ctz(open(b));
+        m_location[slot] = key;
+        m_data[slot] = data;
+    }
+
+    // bucket b just got a free slot: a stashed key that can live there takes it.
+    void unstash(uint64_t b) {
+        bool moved = false;
+        m_stash.drain_if([this, b, &moved](const uint64_t & key) {
+                             const auto k = unhash(key);
+                             return !moved && (first(k) == b || second(k) == b);
+                         },
+                         [this, b, &moved](const uint64_t & key, V & value) {
+                             place(b, key, value);
+                             moved = true;
+                         });
+    }
+};
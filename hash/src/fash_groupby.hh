@@ -0,0 +1,244 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "fash.hh"
+
+// fash_groupby: sum, count, min and max of one or more value columns per key.
+// a fash maps every key to a dense group index (its value slot holds the
+// index, not the aggregates), and the aggregates are columns indexed by group,
+// so a batch of 8 rows is one gather, one op and one scatter per aggregate and
+// the result comes out as plain arrays.
+//
+// 8 rows at a time: keys are hashed together and their buckets prefetched 16
+// rows ahead; the bucket numbers wait in a ring until the rows are looked up
+// (and given a new group if absent), so a key's lookup doesn't hash it again.
+// two rows of the same group in one vector would lose an update in the
+// scatter, so _mm512_conflict_epi64 finds each lane's nearest earlier lane
+// with the same group, and pointer jumping over those links (at most 3 steps
+// for 8 lanes) turns every lane into the running total of its group up to
+// itself. the last lane of a group then carries the whole batch's update, and
+// since a scatter writes lanes in order, it is the one that lands.
+//
+// add_parallel splits the rows over threads, each filling its own partial
+// table, and merges the partials into this one at the end, so no thread ever
+// writes shared state.
+//
+// T is int64_t or double. keys are 64-bit, 0 is reserved. at most capacity()
+// groups, i.e. 8 per bucket of the fash; more throws std::length_error.
+template <class T = int64_t, class H = fash_mix_hash>
+class fash_groupby {
+    static_assert(std::is_same_v<T, int64_t> || std::is_same_v<T, double>, "fash_groupby aggregates int64_t or double");
+    static constexpr unsigned int distance = 16;
+    static constexpr unsigned int ring_size = 32;   // a power of 2 >= distance + 8
+
+    fash<uint64_t, uint64_t, H> m_table;
+    unsigned int m_columns;
+    uint64_t m_capacity;
+    uint64_t m_groups = 0;
+    uint64_t* m_keys;
+    uint64_t* m_count;
+    std::vector<T*> m_sum, m_min, m_max;
+
+public:
+    fash_groupby(unsigned char bit_size, unsigned int columns) : m_table(bit_size), m_columns(columns), m_capacity(8ULL << bit_size) {
+        m_keys = fash_zalloc<uint64_t>(m_capacity);
+        m_count = fash_zalloc<uint64_t>(m_capacity);
+        for(unsigned int c = 0; c < m_columns; ++c) {
+            m_sum.push_back(fash_zalloc<T>(m_capacity));
+            m_min.push_back(fash_zalloc<T>(m_capacity));
+            m_max.push_back(fash_zalloc<T>(m_capacity));
+        }
+    }
+
+    ~fash_groupby() {
+        fash_free(m_keys, m_capacity);
+        fash_free(m_count, m_capacity);
+        for(unsigned int c = 0; c < m_columns; ++c) {
+            fash_free(m_sum[c], m_capacity);
+            fash_free(m_min[c], m_capacity);
+            fash_free(m_max[c], m_capacity);
+        }
+    }
+
+    fash_groupby(const fash_groupby &) = delete;
+    fash_groupby & operator=(const fash_groupby &) = delete;
+
+    // accumulates rows [0, n): keys[i] with columns[c][i] for every column c.
+    void add(const uint64_t* keys, const T* const* columns, size_t n) {
+        const auto vmask = _mm512_set1_epi64(m_table.bucket_count() - 1);
+        alignas(64) uint64_t ring[ring_size];
+        for(size_t a = 0; a < n && a < distance; a += 8)
+            stage(keys, n, a, vmask, ring);
+
+        alignas(64) uint64_t g[8];
+        for(size_t i = 0; i < n; i += 8) {
+            if(i + distance < n)
+                stage(keys, n, i + distance, vmask, ring);
+
+            const unsigned int lanes = std::min<size_t>(8, n - i);
+            const __mmask8 live = lanes == 8 ? 0xFF : (1u << lanes) - 1;
+            for(unsigned int j = 0; j < lanes; ++j)
+                g[j] = group(keys[i + j], ring[(i + j) & (ring_size - 1)]);
+
+            const auto gv = _mm512_maskz_load_epi64(live, g);
+            const auto conf = _mm512_maskz_conflict_epi64(live, gv);
+            const auto link = _mm512_sub_epi64(_mm512_set1_epi64(63), _mm512_lzcnt_epi64(conf));
+            const __mmask8 dup = _mm512_test_epi64_mask(conf, conf);
+
+            update(m_count, gv, live, prefix(_mm512_set1_epi64(1), link, dup, add_op<int64_t>{}), add_op<int64_t>{});
+            for(unsigned int c = 0; c < m_columns; ++c) {
+                const auto v = _mm512_maskz_loadu_epi64(live, columns[c] + i);
+                update(m_sum[c], gv, live, prefix(v, link, dup, add_op<T>{}), add_op<T>{});
+                update(m_min[c], gv, live, prefix(v, link, dup, min_op{}), min_op{});
+                update(m_max[c], gv, live, prefix(v, link, dup, max_op{}), max_op{});
+            }
+        }
+    }
+
+    // add over threads partial tables of this one's size, merged in at the end.
+    void add_parallel(const uint64_t* keys, const T* const* columns, size_t n, unsigned int threads) {
+        if(threads <= 1) {
+            add(keys, columns, n);
+            return;
+        }
+
+        std::vector<std::unique_ptr<fash_groupby>> partials;
+        for(unsigned int t = 1; t < threads; ++t)
+            partials.push_back(std::make_unique<fash_groupby>(m_table.bit_size(), m_columns));
+
+        const size_t chunk = (n / threads + 7) & ~size_t(7);
+        std::vector<std::thread> workers;
+        for(unsigned int t = 1; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                const size_t first = std::min(n, t * chunk);
+                const size_t last = t + 1 == threads ? n : std::min(n, first + chunk);
+                std::vector<const T*> slice(m_columns);
+                for(unsigned int c = 0; c < m_columns; ++c)
+                    slice[c] = columns[c] + first;
+                partials[t - 1]->add(keys + first, slice.data(), last - first);
+            });
+        }
+        add(keys, columns, std::min(n, chunk));
+        for(auto & w : workers)
+            w.join();
+
+        for(auto & p : partials)
+            merge(*p);
+    }
+
+    // folds other's groups into this one's.
+    void merge(const fash_groupby & other) {
+        for(uint64_t s = 0; s < other.m_groups; ++s) {
+            const uint64_t d = group(other.m_keys[s], m_table.bucket_of(other.m_keys[s]));
+            m_count[d] += other.m_count[s];
+            for(unsigned int c = 0; c < m_columns; ++c) {
+                m_sum[c][d] += other.m_sum[c][s];
+                m_min[c][d] = std::min(m_min[c][d], other.m_min[c][s]);
+                m_max[c][d] = std::max(m_max[c][d], other.m_max[c][s]);
+            }
+        }
+    }
+
+    // key's group index, or -1 if the key has no rows.
+    int64_t group_of(const uint64_t & key) {
+        const uint64_t* g = m_table.find_int64(key);
+        return g ? *g : -1;
+    }
+
+    // per group, in order of first appearance.
+    uint64_t size() const { return m_groups; }
+    uint64_t capacity() const { return m_capacity; }
+    unsigned int columns() const { return m_columns; }
+    const uint64_t* keys() const { return m_keys; }
+    const uint64_t* counts() const { return m_count; }
+    const T* sums(unsigned int c) const { return m_sum[c]; }
+    const T* mins(unsigned int c) const { return m_min[c]; }
+    const T* maxs(unsigned int c) const { return m_max[c]; }
+
+private:
+    // key's group, made if absent; b must be key's bucket.
+    inline __attribute__((always_inline)) uint64_t group(const uint64_t & key, uint64_t b) {
+        const uint64_t* found = m_table.find_int64_in(key, b);
+        if(found)
+            return *found;
+
+        if(m_groups == m_capacity)
+            throw std::length_error("fash_groupby: more groups than capacity()");
+        const uint64_t g = m_groups++;
+        m_table.insert_no_intrinsic_int64(key, g);
+        m_keys[g] = key;
+        for(unsigned int c = 0; c < m_columns; ++c) {
+            m_min[c][g] = std::numeric_limits<T>::max();
+            m_max[c][g] = std::numeric_limits<T>::lowest();
+        }
+        return g;
+    }
+
+    // a op b in the lanes of m, a elsewhere, on U's lanes.
+    template <class U>
+    struct add_op {
+        inline __attribute__((always_inline)) __m512i operator()(__mmask8 m, __m512i a, __m512i b) const {
+            if constexpr(std::is_same_v<U, double>)
+                return _mm512_castpd_si512(_mm512_mask_add_pd(_mm512_castsi512_pd(a), m, _mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+            else
+                return _mm512_mask_add_epi64(a, m, a, b);
+        }
+    };
+
+    struct min_op {
+        inline __attribute__((always_inline)) __m512i operator()(__mmask8 m, __m512i a, __m512i b) const {
+            if constexpr(std::is_same_v<T, double>)
+                return _mm512_castpd_si512(_mm512_mask_min_pd(_mm512_castsi512_pd(a), m, _mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+            else
+                return _mm512_mask_min_epi64(a, m, a, b);
+        }
+    };
+
+    struct max_op {
+        inline __attribute__((always_inline)) __m512i operator()(__mmask8 m, __m512i a, __m512i b) const {
+            if constexpr(std::is_same_v<T, double>)
+                return _mm512_castpd_si512(_mm512_mask_max_pd(_mm512_castsi512_pd(a), m, _mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+            else
+                return _mm512_mask_max_epi64(a, m, a, b);
+        }
+    };
+
+    // lane i becomes op over itself and every earlier lane of its group.
+    // link[i] is the nearest such lane (-1 for none); each step folds in the
+    // linked lane's value and doubles the link, so 8 lanes need 3 steps.
+    template <class Op>
+    static inline __attribute__((always_inline)) __m512i prefix(__m512i v, __m512i link, __mmask8 todo, Op op) {
+        const auto none = _mm512_set1_epi64(-1);
+        while(todo) {
+            v = op(todo, v, _mm512_permutexvar_epi64(link, v));
+            link = _mm512_mask_permutexvar_epi64(link, todo, link, link);
+            todo = _mm512_mask_cmpneq_epi64_mask(todo, link, none);
+        }
+        return v;
+    }
+
+    template <class U, class Op>
+    static inline __attribute__((always_inline)) void update(U* column, __m512i gv, __mmask8 live, __m512i v, Op op) {
+        const auto old = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), live, gv, column, 8);
+        _mm512_mask_i64scatter_epi64(column, live, gv, op(live, old, v), 8);
+    }
+
+    // hashes keys[a, a + 8) into the ring (a is a multiple of 8) and
+    // prefetches their buckets.
+    inline __attribute__((always_inline)) void stage(const uint64_t* keys, size_t n, size_t a, __m512i vmask, uint64_t* ring) const {
+        const __mmask8 live = n - a >= 8 ? 0xFF : (1u << (n - a)) - 1;
+        uint64_t* b = ring + (a & (ring_size - 1));
+        _mm512_store_epi64(b, _mm512_and_epi64(H{}(_mm512_maskz_loadu_epi64(live, keys + a)), vmask));
+        for(unsigned int j = 0; j < 8; ++j)
+            if(live >> j & 1)
+                m_table.prefetch_bucket(b[j]);
+    }
+};
@@ -0,0 +1,304 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "fash.hh"
+
+// fash_join: an equi-join of a build side (a key column and a payload column)
+// against probe key columns. the build side is grouped by key in CSR form: a
+// fash maps every distinct key to its group, and group g's payloads are
+// m_payload[m_offsets[g], m_offsets[g + 1]), in build row order. a key that
+// appears once costs one slot and one payload, duplicates cost one payload
+// each and nothing in the table.
+//
+// probe takes a chunk of keys and emits one (probe row, payload) pair per
+// match into caller-owned buffers, either with room for n * max_group() pairs
+// or of a given capacity with a probe_cursor: a probe that runs out of room
+// stops at the first pair it can't write, and calling it again with the same
+// keys and cursor carries on from there, so even a key whose group is bigger
+// than the buffer streams through it. keys are hashed 8 at a time with the vector H and their buckets
+// prefetched 16 keys ahead; the bucket numbers wait in a ring until the keys
+// are looked up, so no key is hashed twice. 8 lookups later the groups are
+// resolved together: the lanes whose
+// group has exactly one row gather their payloads and are compress-stored in
+// one go, and only keys with duplicates fall back to a loop over their group.
+//
+// radix mode (partition_bits > 0): both sides are split by the top bits of the
+// key's hash into 2^partition_bits partitions, each with its own table, and a
+// probe chunk is partitioned before it's joined one partition at a time. with
+// partitions sized to the cache (radix_bits()), each table is cache resident
+// while its keys are probed, where a build side bigger than the LLC would
+// otherwise miss on nearly every probe. pairs come out grouped by partition,
+// and within a block of 8 rows single matches come before duplicates (unless
+// the buffer runs short mid-block, when the rest go out in row order).
+//
+// keys are 64-bit and 0 is reserved, as in fash.
+template <class H = fash_mix_hash>
+class fash_join {
+    using table = fash<uint64_t, uint64_t, H>;
+    static constexpr unsigned int distance = 16;
+    static constexpr unsigned int ring_size = 32;   // a power of 2 >= distance + 8
+
+    unsigned int m_partition_bits;
+    std::vector<std::unique_ptr<table>> m_tables;
+    std::vector<uint64_t> m_offsets;
+    std::vector<uint64_t> m_payload;
+    uint64_t m_max_group = 0;
+
+    // probe side partitioning scratch.
+    std::vector<uint64_t> m_probe_keys;
+    std::vector<uint32_t> m_probe_rows;
+    std::vector<uint64_t> m_probe_start;
+
+public:
+    // where a probe with a capacity stopped. start from a default one and pass
+    // it back with the same keys until done; one in flight per fash_join.
+    struct probe_cursor {
+        bool started = false;
+        bool done = false;
+        uint64_t partition = 0;
+        size_t block = 0;           // first row of the block of 8 in flight
+        unsigned int lanes = 0;     // its lanes already emitted
+        uint64_t emitted = 0;       // pairs of its next duplicate group already emitted
+    };
+
+    fash_join(const uint64_t* keys, const uint64_t* payload, size_t n, unsigned int partition_bits = 0)
+        : m_partition_bits(partition_bits), m_tables(1ULL << partition_bits) {
+        std::vector<uint32_t> order;
+        std::vector<uint64_t> start;
+        partition(keys, n, order, start);
+
+        // group ids are handed out partition by partition, so a partition's
+        // groups (and payloads) are contiguous too.
+        std::vector<uint64_t> group(n);
+        std::vector<uint64_t> count;
+        for(uint64_t q = 0; q < m_tables.size(); ++q) {
+            m_tables[q] = std::make_unique<table>(bits_for(start[q + 1] - start[q]));
+            table & t = *m_tables[q];
+            const auto vmask = _mm512_set1_epi64(t.bucket_count() - 1);
+            alignas(64) uint64_t b[8];
+            for(uint64_t j = start[q]; j < start[q + 1]; ++j) {
+                const uint32_t r = order.empty() ? j : order[j];
+                if((j - start[q]) % 8 == 0) {
+                    const __mmask8 live = start[q + 1] - j >= 8 ? 0xFF : (1u << (start[q + 1] - j)) - 1;
+                    const auto k = order.empty() ? _mm512_maskz_loadu_epi64(live, keys + j)
+                                                 : _mm512_mask_i32gather_epi64(_mm512_setzero_si512(), live, _mm256_maskz_loadu_epi32(live, order.data() + j), keys, 8);
+                    _mm512_store_epi64(b, _mm512_and_epi64(H{}(k), vmask));
+                }
+                const uint64_t* g = t.find_int64_in(keys[r], b[(j - start[q]) % 8]);
+                if(g) {
+                    group[r] = *g;
+                    ++count[*g];
+                } else {
+                    group[r] = count.size();
+                    t.insert_no_intrinsic_int64(keys[r], count.size());
+                    count.push_back(1);
+                }
+            }
+        }
+
+        m_offsets.assign(count.size() + 1, 0);
+        for(uint64_t g = 0; g < count.size(); ++g) {
+            m_offsets[g + 1] = m_offsets[g] + count[g];
+            m_max_group = std::max(m_max_group, count[g]);
+        }
+
+        m_payload.resize(n);
+        std::vector<uint64_t> next(m_offsets.begin(), m_offsets.end() - 1);
+        for(size_t r = 0; r < n; ++r)
+            m_payload[next[group[r]]++] = payload[r];
+    }
+
+    fash_join(const fash_join &) = delete;
+    fash_join & operator=(const fash_join &) = delete;
+
+    // joins probe rows [0, n) of keys, reported as row_base + row. returns the
+    // number of pairs written to out_row/out_payload, which must have room for
+    // n * max_group().
+    size_t probe(const uint64_t* keys, size_t n, uint64_t* out_row, uint64_t* out_payload, uint64_t row_base = 0) {
+        probe_cursor c;
+        return probe(keys, n, out_row, out_payload, std::numeric_limits<size_t>::max(), c, row_base);
+    }
+
+    // as above, writing at most capacity pairs and leaving c where it stopped.
+    // the probe is finished once c.done; until then call again with the same
+    // keys, n and c for the next pairs.
+    size_t probe(const uint64_t* keys, size_t n, uint64_t* out_row, uint64_t* out_payload, size_t capacity, probe_cursor & c, uint64_t row_base = 0) {
+        if(c.done)
+            return 0;
+
+        if(m_partition_bits == 0) {
+            c.started = true;
+            const size_t count = probe_partition<false>(*m_tables[0], keys, nullptr, n, row_base, out_row, out_payload, capacity, c);
+            c.done = c.block == n;
+            return count;
+        }
+
+        if(!c.started) {
+            partition(keys, n, m_probe_rows, m_probe_start);
+            m_probe_keys.resize(n);
+            for(size_t j = 0; j < n; ++j)
+                m_probe_keys[j] = keys[m_probe_rows[j]];
+            c.started = true;
+        }
+
+        size_t count = 0;
+        for(; c.partition < m_tables.size(); ++c.partition, c.block = 0) {
+            const uint64_t first = m_probe_start[c.partition];
+            const uint64_t rows = m_probe_start[c.partition + 1] - first;
+            count += probe_partition<true>(*m_tables[c.partition], m_probe_keys.data() + first, m_probe_rows.data() + first,
+                                           rows, row_base, out_row + count, out_payload + count, capacity - count, c);
+            if(c.block < rows)
+                return count;
+        }
+        c.done = true;
+        return count;
+    }
+
+    // the partition count that keeps one partition's table, groups and
+    // payloads within cache_bytes. 0 when the whole build side already fits.
+    static unsigned int radix_bits(size_t build_rows, size_t cache_bytes = 1 << 20) {
+        const uint64_t bytes = build_rows * 48;
+        if(bytes <= cache_bytes)
+            return 0;
+        return 64 - __builtin_clzll((bytes - 1) / cache_bytes);
+    }
+
+    uint64_t group_count() const { return m_offsets.size() - 1; }
+    uint64_t build_size() const { return m_payload.size(); }
+    uint64_t max_group() const { return m_max_group; }
+    unsigned int partition_bits() const { return m_partition_bits; }
+
+private:
+    // buckets for about 8 keys each: half of a bucket's 16 slots.
+    static unsigned char bits_for(uint64_t keys) {
+        const uint64_t buckets = (keys + 7) / 8;
+        return buckets <= 1 ? 0 : 64 - __builtin_clzll(buckets - 1);
+    }
+
+    inline __attribute__((always_inline)) uint64_t partition_of(const uint64_t & key) const {
+        return m_partition_bits ? H{}(key) >> (64 - m_partition_bits) : 0;
+    }
+
+    // a counting sort of row indices by partition, with start[q] the first
+    // of partition q. without partitions order is left empty: rows in order.
+    void partition(const uint64_t* keys, size_t n, std::vector<uint32_t> & order, std::vector<uint64_t> & start) const {
+        start.assign(m_tables.size() + 1, 0);
+        if(m_partition_bits == 0) {
+            start[1] = n;
+            order.clear();
+            return;
+        }
+
+        for(size_t i = 0; i < n; ++i)
+            ++start[partition_of(keys[i]) + 1];
+        for(uint64_t q = 0; q < m_tables.size(); ++q)
+            start[q + 1] += start[q];
+
+        order.resize(n);
+        std::vector<uint64_t> next(start.begin(), start.end() - 1);
+        for(size_t i = 0; i < n; ++i)
+            order[next[partition_of(keys[i])]++] = i;
+    }
+
+    // probes rows [c.block, n), skipping what c says was already emitted.
+    // stops before the (capacity + 1)th pair with c.block < n, else c.block = n.
+    template <bool Indexed>
+    size_t probe_partition(table & t, const uint64_t* keys, const uint32_t* rows, size_t n, uint64_t row_base, uint64_t* out_row, uint64_t* out_payload,
+                           size_t capacity, probe_cursor & c) {
+        const auto vmask = _mm512_set1_epi64(t.bucket_count() - 1);
+        const auto zero = _mm512_setzero_si512();
+        const auto iota = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+        size_t count = 0;
+
+        // c is only read here and written on the way out: out_row and
+        // out_payload may alias it as far as the compiler knows.
+        const size_t resume = c.block;
+        __mmask8 resume_lanes = c.lanes;
+        uint64_t skip = c.emitted;
+
+        alignas(64) uint64_t ring[ring_size];
+        for(size_t a = resume; a < n && a < resume + distance; a += 8)
+            stage(t, keys, n, a, vmask, ring);
+
+        uint64_t g[8];
+        for(size_t i = resume; i < n; i += 8) {
+            if(i + distance < n)
+                stage(t, keys, n, i + distance, vmask, ring);
+
+            __mmask8 done = resume_lanes;
+            resume_lanes = 0;
+
+            const unsigned int lanes = std::min<size_t>(8, n - i);
+            __mmask8 hit = 0;
+            for(unsigned int j = 0; j < lanes; ++j) {
+                const uint64_t* found = t.find_int64_in(keys[i + j], ring[(i + j) & (ring_size - 1)]);
+                g[j] = found ? *found : 0;
+                hit |= __mmask8(found != nullptr) << j;
+            }
+            hit &= ~done;
+            if(!hit)
+                continue;
+
+            const auto gv = _mm512_loadu_epi64(g);
+            const auto begin = _mm512_mask_i64gather_epi64(zero, hit, gv, m_offsets.data(), 8);
+            const auto end = _mm512_mask_i64gather_epi64(zero, hit, gv, m_offsets.data() + 1, 8);
+            const __mmask8 single = _mm512_mask_cmpeq_epi64_mask(hit, _mm512_sub_epi64(end, begin), _mm512_set1_epi64(1));
+            const auto row = Indexed ? _mm512_add_epi64(_mm512_cvtepu32_epi64(_mm256_maskz_loadu_epi32(hit, rows + i)), _mm512_set1_epi64(row_base))
+                                     : _mm512_add_epi64(_mm512_set1_epi64(row_base + i), iota);
+
+            if(single && capacity - count >= size_t(__builtin_popcount(single))) {
+                const auto payload = _mm512_mask_i64gather_epi64(zero, single, begin, m_payload.data(), 8);
+                _mm512_mask_compressstoreu_epi64(out_row + count, single, row);
+                _mm512_mask_compressstoreu_epi64(out_payload + count, single, payload);
+                count += __builtin_popcount(single);
+                done |= single;
+                hit &= ~single;
+            }
+
+            // duplicates, and singles there was no room for all at once, one
+            // lane at a time in lane order, so a lane cut short is the first
+            // one left when the block is resumed.
+            for(; hit; hit &= hit - 1) {
+                const unsigned int j = __builtin_ctz(hit);
+                const uint64_t r = row_base + (Indexed ? rows[i + j] : i + j);
+                const uint64_t first = m_offsets[g[j]] + skip;
+                const uint64_t last = first + std::min<uint64_t>(m_offsets[g[j] + 1] - first, capacity - count);
+                for(uint64_t p = first; p < last; p += 8) {
+                    const __mmask8 m = last - p >= 8 ? 0xFF : (1u << (last - p)) - 1;
+                    _mm512_mask_storeu_epi64(out_row + count, m, _mm512_set1_epi64(r));
+                    _mm512_mask_storeu_epi64(out_payload + count, m, _mm512_maskz_loadu_epi64(m, m_payload.data() + p));
+                    count += __builtin_popcount(m);
+                }
+                if(last < m_offsets[g[j] + 1]) {
+                    c.block = i;
+                    c.lanes = done;
+                    c.emitted = last - m_offsets[g[j]];
+                    return count;
+                }
+                skip = 0;
+                done |= 1u << j;
+            }
+        }
+
+        c.block = n;
+        c.lanes = 0;
+        c.emitted = 0;
+        return count;
+    }
+
+    // hashes keys[a, a + 8) into the ring (a is a multiple of 8) and
+    // prefetches their buckets.
+    inline __attribute__((always_inline)) void stage(const table & t, const uint64_t* keys, size_t n, size_t a, __m512i vmask, uint64_t* ring) const {
+        const __mmask8 live = n - a >= 8 ? 0xFF : (1u << (n - a)) - 1;
+        uint64_t* b = ring + (a & (ring_size - 1));
+        _mm512_store_epi64(b, _mm512_and_epi64(H{}(_mm512_maskz_loadu_epi64(live, keys + a)), vmask));
+        for(unsigned int j = 0; j < 8; ++j)
+            if(live >> j & 1)
+                t.prefetch_bucket(b[j]);
+    }
+};
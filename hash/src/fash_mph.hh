@@ -0,0 +1,280 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "fash.hh"
+
+// fash_mph: a read-only table over a fixed key set, built once around a
+// minimal perfect hash in the style of PTHash. every key gets its own slot in
+// [0, n), keys and values are stored densely in slot order, and a lookup is
+// one hash, one pilot load, one key compare: no bucket scan and no slack.
+//
+// layout of the hash:
+//   - the key's 64-bit hash h picks a bucket from about 6n / log2(n) buckets.
+//     the mapping is skewed (60% of keys into the first 30% of buckets) so a
+//     few buckets are large and get placed first, while the table is empty.
+//   - each bucket has a 16-bit pilot, and a key's position is
+//     ((h ^ pilot * k1) * k2) >> 32, range reduced to the table size. the
+//     build tries pilots 0, 1, ... per bucket, biggest buckets first, until
+//     all of the bucket's keys land on free positions.
+//   - positions are searched over n / 0.98 slots, which keeps the last
+//     buckets from searching forever. the ~2% of keys placed beyond n are
+//     remapped to the holes below n through a small table, so the key and
+//     value arrays are exactly n long.
+//
+// a key outside the set lands on some slot and fails the compare. a build
+// whose pilot search overflows 16 bits restarts with the next seed. H must be
+// a bijection (fash_mix_hash is) so that distinct keys have distinct hashes;
+// duplicate keys throw std::invalid_argument.
+//
+// at_batch resolves 8 keys per vector: hash, bucket, pilot gather, position,
+// remap gather and key compare are all vector ops, and positions for 64 keys
+// are computed and their slots prefetched before any of them is compared.
+template <class V, class H = fash_mix_hash>
+class fash_mph {
+    static constexpr uint64_t k1 = 0x9e3779b97f4a7c15ULL;
+    static constexpr uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    static constexpr uint64_t dense_share = uint64_t(0.6 * 4294967296.0);
+
+    uint64_t m_n = 0;           // keys
+    uint64_t m_slots = 0;       // positions searched over, m_n / 0.98
+    uint64_t m_buckets = 0, m_dense_buckets = 0;
+    uint64_t m_seed = 0;
+    uint64_t* __restrict m_keys = nullptr;
+    V* __restrict m_data = nullptr;
+    std::vector<uint16_t> m_pilots;
+    std::vector<uint32_t> m_remap;
+
+public:
+    using key_type = uint64_t;
+    using value_type = V;
+
+    fash_mph(const uint64_t* keys, const V* values, size_t n) : m_n(n) {
+        m_slots = std::max<uint64_t>(m_n + m_n / 49, 1);
+        const uint64_t lg = std::max(1, 64 - __builtin_clzll(m_n | 1));
+        m_buckets = std::max<uint64_t>((6 * m_n + lg - 1) / lg, 1);
+        m_dense_buckets = std::max<uint64_t>(m_buckets * 3 / 10, 1);
+
+        std::vector<uint64_t> slot_of(n);
+        while(!build(keys, slot_of))
+            ++m_seed;
+
+        m_keys = fash_zalloc<uint64_t>(std::max<uint64_t>(m_n, 1));
+        m_data = fash_zalloc<V>(std::max<uint64_t>(m_n, 1));
+        for(size_t i = 0; i < n; ++i) {
+            m_keys[slot_of[i]] = keys[i];
+            m_data[slot_of[i]] = values[i];
+        }
+    }
+
+    ~fash_mph() {
+        fash_free(m_keys, std::max<uint64_t>(m_n, 1));
+        fash_free(m_data, std::max<uint64_t>(m_n, 1));
+    }
+
+    fash_mph(const fash_mph &) = delete;
+    fash_mph & operator=(const fash_mph &) = delete;
+
+    // an empty set still has one slot, holding key 0, hence the m_n test.
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        const uint64_t s = slot(key);
+        return m_n && m_keys[s] == key ? m_data + s : nullptr;
+    }
+
+    inline __attribute__((always_inline)) V & at_int64(const uint64_t & key) {
+        auto found = find_int64(key);
+        if(!found)
+            throw std::out_of_range("fash_mph::at_int64");
+        return *found;
+    }
+
+    bool contains_int64(const uint64_t & key) {
+        return find_int64(key) != nullptr;
+    }
+
+    // as fash128x::at_batch: out[i] is left alone for a key outside the set,
+    // found (if given) gets a 0/1 per key and the return value is the number
+    // of misses.
+    size_t at_batch(const uint64_t* keys, size_t n, V* out, unsigned char* found = nullptr) {
+        if(m_n == 0) {
+            if(found)
+                std::fill(found, found + n, 0);
+            return n;
+        }
+
+        alignas(64) uint64_t pos[64];
+        size_t misses = 0;
+
+        for(size_t base = 0; base < n; base += 64) {
+            const size_t len = std::min<size_t>(64, n - base);
+            for(size_t j = 0; j < len; j += 8) {
+                const __mmask8 live = len - j >= 8 ? 0xFF : (1u << (len - j)) - 1;
+                const auto s = slot(_mm512_maskz_loadu_epi64(live, keys + base + j), live);
+                _mm512_store_epi64(pos + j, s);
+                for(unsigned int l = 0; l < 8; ++l)
+                    __builtin_prefetch(m_keys + pos[j + l]);
+            }
+
+            for(size_t j = 0; j < len; j += 8) {
+                const __mmask8 live = len - j >= 8 ? 0xFF : (1u << (len - j)) - 1;
+                const auto s = _mm512_load_epi64(pos + j);
+                const auto k = _mm512_maskz_loadu_epi64(live, keys + base + j);
+                const __mmask8 hit = _mm512_mask_cmpeq_epi64_mask(live, k, _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), live, s, m_keys, 8));
+
+                if constexpr(sizeof(V) == 8) {
+                    const auto v = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), hit, s, m_data, 8);
+                    _mm512_mask_storeu_epi64(out + base + j, hit, v);
+                } else {
+                    for(unsigned int h = hit; h; h &= h - 1)
+                        out[base + j + __builtin_ctz(h)] = m_data[pos[j + __builtin_ctz(h)]];
+                }
+
+                misses += __builtin_popcount(live & ~hit);
+                if(found)
+                    for(unsigned int l = 0; l < 8 && j + l < len; ++l)
+                        found[base + j + l] = hit >> l & 1;
+            }
+        }
+
+        return misses;
+    }
+
+    uint64_t size() const { return m_n; }
+    uint64_t bucket_count() const { return m_buckets; }
+    uint64_t seed() const { return m_seed; }
+
+    // everything a lookup touches: keys, values, pilots and the remap table.
+    uint64_t bytes() const { return m_n * (sizeof(uint64_t) + sizeof(V)) + index_bytes(); }
+    uint64_t index_bytes() const { return m_pilots.size() * sizeof(uint16_t) + m_remap.size() * sizeof(uint32_t); }
+
+private:
+    inline __attribute__((always_inline)) uint64_t hash(const uint64_t & key) const {
+        return H{}(key + m_seed);
+    }
+
+    inline __attribute__((always_inline)) uint64_t bucket(uint64_t h) const {
+        const uint64_t hi = h >> 32;
+        if((h & 0xFFFFFFFF) < dense_share)
+            return (hi * m_dense_buckets) >> 32;
+        return m_dense_buckets + ((hi * (m_buckets - m_dense_buckets)) >> 32);
+    }
+
+    inline __attribute__((always_inline)) uint64_t position(uint64_t h, uint64_t pilot) const {
+        return ((((h ^ (pilot * k1)) * k2) >> 32) * m_slots) >> 32;
+    }
+
+    inline __attribute__((always_inline)) uint64_t slot(const uint64_t & key) const {
+        const uint64_t h = hash(key);
+        const uint64_t p = position(h, m_pilots[bucket(h)]);
+        return p < m_n ? p : m_remap[p - m_n];
+    }
+
+    // slot() on 8 keys. the pilot and remap arrays are read with 64-bit
+    // gathers at 2 and 4 byte strides and masked down, which is why both
+    // carry a few entries of padding.
+    inline __attribute__((always_inline)) __m512i slot(__m512i key, __mmask8 live) const {
+        const auto lo32 = _mm512_set1_epi64(0xFFFFFFFF);
+        const auto h = H{}(_mm512_add_epi64(key, _mm512_set1_epi64(m_seed)));
+        const auto hi = _mm512_srli_epi64(h, 32);
+
+        const __mmask8 dense = _mm512_cmplt_epu64_mask(_mm512_and_epi64(h, lo32), _mm512_set1_epi64(dense_share));
+        const auto b_dense = _mm512_srli_epi64(_mm512_mul_epu32(hi, _mm512_set1_epi64(m_dense_buckets)), 32);
+        const auto b_sparse = _mm512_add_epi64(_mm512_set1_epi64(m_dense_buckets),
+                                               _mm512_srli_epi64(_mm512_mul_epu32(hi, _mm512_set1_epi64(m_buckets - m_dense_buckets)), 32));
+        const auto b = _mm512_mask_blend_epi64(dense, b_sparse, b_dense);
+
+        const auto pilot = _mm512_and_epi64(_mm512_mask_i64gather_epi64(_mm512_setzero_si512(), live, b, m_pilots.data(), 2), _mm512_set1_epi64(0xFFFF));
+        const auto x = _mm512_mullox_epi64(_mm512_xor_epi64(h, _mm512_mullox_epi64(pilot, _mm512_set1_epi64(k1))), _mm512_set1_epi64(k2));
+        const auto p = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(x, 32), _mm512_set1_epi64(m_slots)), 32);
+
+        const __mmask8 far = _mm512_mask_cmpge_epu64_mask(live, p, _mm512_set1_epi64(m_n));
+        if(!far)
+            return p;
+        const auto r = _mm512_mask_i64gather_epi64(p, far, _mm512_sub_epi64(p, _mm512_set1_epi64(m_n)), m_remap.data(), 4);
+        return _mm512_mask_and_epi64(p, far, r, lo32);
+    }
+
+    // one attempt at placing every key with the current seed. false when
+    // some bucket needs a pilot beyond 16 bits.
+    bool build(const uint64_t* keys, std::vector<uint64_t> & slot_of) {
+        const uint64_t n = m_n;
+        std::vector<uint64_t> h(n), start(m_buckets + 1, 0);
+        for(uint64_t i = 0; i < n; ++i) {
+            h[i] = hash(keys[i]);
+            ++start[bucket(h[i]) + 1];
+        }
+        for(uint64_t b = 0; b < m_buckets; ++b)
+            start[b + 1] += start[b];
+
+        std::vector<uint32_t> members(n);
+        std::vector<uint64_t> next(start.begin(), start.end() - 1);
+        for(uint64_t i = 0; i < n; ++i)
+            members[next[bucket(h[i])]++] = i;
+
+        // buckets by size, biggest first (a counting sort on size).
+        uint64_t largest = 0;
+        for(uint64_t b = 0; b < m_buckets; ++b)
+            largest = std::max(largest, start[b + 1] - start[b]);
+        std::vector<uint64_t> by_size(largest + 2, 0);
+        for(uint64_t b = 0; b < m_buckets; ++b)
+            ++by_size[largest - (start[b + 1] - start[b]) + 1];
+        for(uint64_t s = 0; s <= largest; ++s)
+            by_size[s + 1] += by_size[s];
+        std::vector<uint32_t> order(m_buckets);
+        for(uint64_t b = 0; b < m_buckets; ++b)
+            order[by_size[largest - (start[b + 1] - start[b])]++] = b;
+
+        m_pilots.assign(m_buckets + 4, 0);
+        std::vector<uint64_t> taken((m_slots + 63) / 64, 0);
+        std::vector<uint64_t> pos;
+        for(const uint32_t b : order) {
+            const uint64_t first = start[b], last = start[b + 1];
+            if(first == last)
+                break;
+
+            // equal keys share a hash, so they'd share every position.
+            for(uint64_t j = first; j < last; ++j)
+                for(uint64_t k = j + 1; k < last; ++k)
+                    if(h[members[j]] == h[members[k]])
+                        throw std::invalid_argument("fash_mph: duplicate key");
+
+            bool placed = false;
+            for(uint64_t pilot = 0; pilot < 65536 && !placed; ++pilot) {
+                pos.clear();
+                placed = true;
+                for(uint64_t j = first; j < last && placed; ++j) {
+                    const uint64_t p = position(h[members[j]], pilot);
+                    placed = !(taken[p >> 6] >> (p & 63) & 1) && std::find(pos.begin(), pos.end(), p) == pos.end();
+                    pos.push_back(p);
+                }
+                if(placed) {
+                    m_pilots[b] = pilot;
+                    for(uint64_t j = first; j < last; ++j) {
+                        taken[pos[j - first] >> 6] |= 1ULL << (pos[j - first] & 63);
+                        slot_of[members[j]] = pos[j - first];
+                    }
+                }
+            }
+
+            if(!placed)
+                return false;
+        }
+
+        // positions past n move to the holes below n, in order.
+        m_remap.assign(m_slots - n + 2, 0);
+        uint64_t hole = 0;
+        for(uint64_t i = 0; i < n; ++i) {
+            if(slot_of[i] < n)
+                continue;
+            while(taken[hole >> 6] >> (hole & 63) & 1)
+                ++hole;
+            taken[hole >> 6] |= 1ULL << (hole & 63);
+            m_remap[slot_of[i] - n] = hole;
+            slot_of[i] = hole;
+        }
+        return true;
+    }
+};
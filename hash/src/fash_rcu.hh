@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "fash.hh"
+
+// fash_rcu: a versioned handle to a read-only fash that writers replace
+// wholesale. a writer builds the next version off to the side and publish()
+// swaps it in with one pointer store; readers keep reading whichever version
+// they pinned, and a retired version is freed once no reader can still hold it.
+//
+// readers are numbered [0, readers) by the caller, one id per thread, and
+// pin the current version around a batch of lookups. a reader announces the
+// global epoch in its own cache line and then loads the table pointer: a
+// plain store and a plain load, no atomic RMW and no fence, so the read path
+// costs what an unpinned lookup does plus a store per batch. the store has to
+// be visible before the load, which x86 doesn't promise on its own; the
+// writer pays for that instead, with membarrier(PRIVATE_EXPEDITED) forcing a
+// full barrier on every cpu running one of our threads before it scans the
+// readers' epochs. (kernels without it: readers fall back to a fence.)
+//
+// publish bumps the epoch after the swap and tags the old version with the
+// new epoch e. a reader whose announced epoch is e or later read the pointer
+// after the swap, so the old version is free once every pinned reader shows
+// e or later; idle readers show 0. versions a slow reader still holds stay
+// on the retired list and are retried on the next publish or reclaim().
+//
+// pins don't nest, and a pinned reader must not wait on a writer. writers are
+// serialised by a mutex, and the tables must not be modified once published.
+template <class K, class V, class H = fash_mix_hash, class A = fash_small_pages>
+class fash_rcu {
+public:
+    using table = fash<K, V, H, A>;
+
+private:
+    struct alignas(64) reader_slot {
+        std::atomic<uint64_t> epoch{0};
+    };
+
+    std::atomic<table*> m_current;
+    alignas(64) std::atomic<uint64_t> m_epoch{1};
+    std::unique_ptr<reader_slot[]> m_readers;
+    unsigned int m_reader_count;
+    bool m_fenced_readers;
+
+    std::mutex m_writer;
+    std::vector<std::pair<uint64_t, table*>> m_retired;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    // a pinned version, unpinned when it goes out of scope.
+    class pinned {
+        fash_rcu* m_rcu;
+        unsigned int m_reader;
+        table* m_table;
+
+    public:
+        pinned(fash_rcu* rcu, unsigned int reader, table* t) : m_rcu(rcu), m_reader(reader), m_table(t) {
+        }
+        ~pinned() {
+            m_rcu->unpin(m_reader);
+        }
+        pinned(const pinned &) = delete;
+        pinned & operator=(const pinned &) = delete;
+
+        table * operator->() const { return m_table; }
+        table & operator*() const { return *m_table; }
+    };
+
+    fash_rcu(std::unique_ptr<table> first, unsigned int readers = 64)
+        : m_current(first.release()), m_readers(new reader_slot[readers]), m_reader_count(readers) {
+        m_fenced_readers = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) != 0;
+    }
+
+    // no reader may be pinned.
+    ~fash_rcu() {
+        delete m_current.load(std::memory_order_relaxed);
+        for(auto & r : m_retired)
+            delete r.second;
+    }
+
+    fash_rcu(const fash_rcu &) = delete;
+    fash_rcu & operator=(const fash_rcu &) = delete;
+
+    inline __attribute__((always_inline)) table * pin(unsigned int reader) {
+        m_readers[reader].epoch.store(m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        if(m_fenced_readers)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        else
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        return m_current.load(std::memory_order_acquire);
+    }
+
+    inline __attribute__((always_inline)) void unpin(unsigned int reader) {
+        m_readers[reader].epoch.store(0, std::memory_order_release);
+    }
+
+    inline __attribute__((always_inline)) pinned read(unsigned int reader) {
+        return pinned(this, reader, pin(reader));
+    }
+
+    // reader's lookup of key, copied out so nothing outlives the pin.
+    inline __attribute__((always_inline)) bool find_int64(unsigned int reader, const uint64_t & key, V & out) {
+        const V* found = pin(reader)->find_int64(key);
+        if(found)
+            out = *found;
+        unpin(reader);
+        return found != nullptr;
+    }
+
+    // makes next the current version and frees every retired version that no
+    // reader still holds. returns the number left on the retired list.
+    size_t publish(std::unique_ptr<table> next) {
+        std::lock_guard<std::mutex> guard(m_writer);
+        table* old = m_current.exchange(next.release(), std::memory_order_seq_cst);
+        m_retired.emplace_back(m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1, old);
+        return reclaim_locked();
+    }
+
+    size_t reclaim() {
+        std::lock_guard<std::mutex> guard(m_writer);
+        return reclaim_locked();
+    }
+
+    // publishes since construction.
+    uint64_t version() const { return m_epoch.load(std::memory_order_relaxed) - 1; }
+    size_t retired() {
+        std::lock_guard<std::mutex> guard(m_writer);
+        return m_retired.size();
+    }
+    unsigned int readers() const { return m_reader_count; }
+
+private:
+    size_t reclaim_locked() {
+        if(m_retired.empty())
+            return 0;
+
+        if(m_fenced_readers)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        else if(syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) != 0)
+            return m_retired.size();
+
+        uint64_t oldest = std::numeric_limits<uint64_t>::max();
+        for(unsigned int r = 0; r < m_reader_count; ++r) {
+            const uint64_t e = m_readers[r].epoch.load(std::memory_order_acquire);
+            if(e && e < oldest)
+                oldest = e;
+        }
+
+        size_t kept = 0;
+        for(auto & r : m_retired) {
+            if(r.first <= oldest)
+                delete r.second;
+            else
+                m_retired[kept++] = r;
+        }
+        m_retired.resize(kept);
+        return kept;
+    }
+};
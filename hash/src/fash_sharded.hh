@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+#include "fash.hh"
+
+// the cpus of every NUMA node this process may run on, from sysfs (node ids
+// from /sys/devices/system/node/online, each node's cpus from its cpulist).
+// nodes without usable cpus are left out; without sysfs it's one node holding
+// every allowed cpu.
+inline std::vector<std::vector<int>> fash_node_cpus() {
+    const auto parse = [](const std::string & list) {
+        std::vector<int> out;
+        std::stringstream in(list);
+        for(std::string range; std::getline(in, range, ',');) {
+            if(range.empty() || !isdigit(range[0]))
+                continue;
+            const auto dash = range.find('-');
+            const int first = std::stoi(range);
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int c = first; c <= last; ++c)
+                out.push_back(c);
+        }
+        return out;
+    };
+    const auto read = [](const std::string & path) {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    };
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        for(int c = 0; c < CPU_SETSIZE; ++c)
+            CPU_SET(c, &allowed);
+
+    std::vector<std::vector<int>> nodes;
+    for(int node : parse(read("/sys/devices/system/node/online"))) {
+        std::vector<int> cpus;
+        for(int c : parse(read("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")))
+            if(c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+                cpus.push_back(c);
+        if(!cpus.empty())
+            nodes.push_back(std::move(cpus));
+    }
+
+    if(nodes.empty()) {
+        nodes.emplace_back();
+        for(int c = 0; c < CPU_SETSIZE; ++c)
+            if(CPU_ISSET(c, &allowed))
+                nodes.back().push_back(c);
+    }
+    return nodes;
+}
+
+// a cpu for each of owners threads, dealt round-robin over the nodes: owner w
+// runs on node w % nodes, on that node's (w / nodes)-th cpu (wrapping).
+inline std::vector<int> fash_owner_cpus(unsigned int owners) {
+    const auto nodes = fash_node_cpus();
+    std::vector<int> cpus;
+    for(unsigned int w = 0; w < owners; ++w) {
+        const auto & node = nodes[w % nodes.size()];
+        cpus.push_back(node[(w / nodes.size()) % node.size()]);
+    }
+    return cpus;
+}
+
+// fash_sharded: 2^shard_bits independent tables of type T, each holding the
+// keys whose hash has its shard number in bits [57 - shard_bits, 57). fash and
+// fash128x pick buckets from the low bits and fash128x its probe start from the
+// top 7, so the shard bits are ones neither table looks at and every shard
+// still sees an even spread of buckets.
+//
+// owners: with owners > 0 the wrapper keeps that many worker threads (at most
+// one per shard), and shard s belongs to worker s % owners. worker w is pinned
+// to fash_owner_cpus' cpu w, so owners alternate between NUMA nodes and so do
+// consecutive shards; callers with their own placement pass a cpu per owner
+// instead (-1 leaves that one unpinned, as does pin = false). each worker
+// constructs its own shards, so with T on fash_touched_pages storage every
+// shard is first-touched, i.e. placed, on its owner's node. the *_owned calls
+// then route a batch by shard and let each owner work on its own shards only,
+// so every probe is node-local. with owners == 0 everything runs on the
+// calling thread, which is the node oblivious layout: all shards land wherever
+// the caller happens to run.
+//
+// find_int64 and insert_no_intrinsic_int64 go straight to the key's shard from
+// the calling thread. the *_owned calls share scratch space and the worker
+// pool, so only one thread may issue them at a time.
+template <class T, class H = fash_mix_hash>
+class fash_sharded {
+    using V = typename T::value_type;
+
+    unsigned char m_shard_bits;
+    uint64_t m_shard_m1;
+    std::vector<std::unique_ptr<T>> m_shards;
+
+    std::vector<std::thread> m_workers;
+    std::atomic<uint64_t> m_epoch{0};
+    std::atomic<unsigned int> m_pending{0};
+    const std::function<void(uint64_t)>* m_job = nullptr;
+    bool m_stop = false;
+
+    // batch routing scratch: shard of every key, then key indices grouped by
+    // shard with m_start[s] the first of shard s.
+    std::vector<unsigned short> m_route;
+    std::vector<uint32_t> m_order;
+    std::vector<uint64_t> m_start;
+    std::vector<uint64_t> m_misses;
+
+public:
+    using key_type = typename T::key_type;
+    using value_type = V;
+
+    // bit_size is per shard, as T's constructor takes it.
+    fash_sharded(unsigned char shard_bits, unsigned char bit_size, unsigned int owners = 0, bool pin = true)
+        : fash_sharded(shard_bits, bit_size, pin ? fash_owner_cpus(std::min<uint64_t>(owners, 1ULL << shard_bits))
+                                                 : std::vector<int>(std::min<uint64_t>(owners, 1ULL << shard_bits), -1)) {
+    }
+
+    // one owner per entry of cpus (past the shard count they're ignored),
+    // pinned to that cpu.
+    fash_sharded(unsigned char shard_bits, unsigned char bit_size, const std::vector<int> & cpus)
+        : m_shard_bits(shard_bits), m_shard_m1((1ULL << shard_bits) - 1), m_shards(1ULL << shard_bits), m_misses(1ULL << shard_bits) {
+        const unsigned int owners = std::min<uint64_t>(cpus.size(), m_shards.size());
+        for(unsigned int w = 0; w < owners; ++w)
+            m_workers.emplace_back([this, w, owners, cpu = cpus[w]] { work(w, owners, cpu); });
+
+        for_each_owned([this, bit_size](uint64_t s) { m_shards[s] = std::make_unique<T>(bit_size); });
+    }
+
+    ~fash_sharded() {
+        m_stop = true;
+        m_epoch.fetch_add(1, std::memory_order_release);
+        m_epoch.notify_all();
+        for(auto & w : m_workers)
+            w.join();
+    }
+
+    fash_sharded(const fash_sharded &) = delete;
+    fash_sharded & operator=(const fash_sharded &) = delete;
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        return m_shards[shard_of(key)]->find_int64(key);
+    }
+
+    void insert_no_intrinsic_int64(const uint64_t & key, V data) {
+        m_shards[shard_of(key)]->insert_no_intrinsic_int64(key, data);
+    }
+
+    // inserts n pairs, each by the owner of its shard.
+    void insert_owned(const uint64_t* keys, const V* values, size_t n) {
+        route(keys, n);
+        for_each_owned([this, keys, values](uint64_t s) {
+            T & shard = *m_shards[s];
+            for(uint64_t j = m_start[s]; j < m_start[s + 1]; ++j)
+                shard.insert_no_intrinsic_int64(keys[m_order[j]], values[m_order[j]]);
+        });
+    }
+
+    // at_batch with every key looked up by the owner of its shard. out[i] is
+    // left alone for a missing key; found (if given) gets a 0/1 per key and
+    // the return value is the number of misses. owners write straight into out
+    // at the keys' original positions.
+    size_t at_batch_owned(const uint64_t* keys, size_t n, V* out, unsigned char* found = nullptr) {
+        route(keys, n);
+        for_each_owned([this, keys, out, found](uint64_t s) {
+            T & shard = *m_shards[s];
+            const uint64_t end = m_start[s + 1];
+            uint64_t misses = 0;
+            for(uint64_t j = m_start[s]; j < end; ++j) {
+                const uint32_t i = m_order[j];
+                if(j + 8 < end)
+                    shard.prefetch_int64(keys[m_order[j + 8]]);
+                V* hit = shard.find_int64(keys[i]);
+                if(hit)
+                    out[i] = *hit;
+                else
+                    ++misses;
+                if(found)
+                    found[i] = hit != nullptr;
+            }
+            m_misses[s] = misses;
+        });
+
+        size_t misses = 0;
+        for(auto m : m_misses)
+            misses += m;
+        return misses;
+    }
+
+    // runs f(s) for every shard s, on s's owner (or inline without owners),
+    // and returns once all of them are done.
+    void for_each_owned(const std::function<void(uint64_t)> & f) {
+        if(m_workers.empty()) {
+            for(uint64_t s = 0; s < m_shards.size(); ++s)
+                f(s);
+            return;
+        }
+
+        m_job = &f;
+        m_pending.store(m_workers.size(), std::memory_order_relaxed);
+        m_epoch.fetch_add(1, std::memory_order_release);
+        m_epoch.notify_all();
+        for(unsigned int p; (p = m_pending.load(std::memory_order_acquire)) != 0; )
+            m_pending.wait(p);
+    }
+
+    inline __attribute__((always_inline)) uint64_t shard_of(const uint64_t & key) const {
+        return (H{}(key) >> (57 - m_shard_bits)) & m_shard_m1;
+    }
+
+    uint64_t shard_count() const { return m_shards.size(); }
+    unsigned int owner_count() const { return m_workers.size(); }
+    T & shard(uint64_t s) { return *m_shards[s]; }
+
+private:
+    void work(unsigned int w, unsigned int owners, int cpu) {
+        if(cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+
+        uint64_t seen = 0;
+        for(;;) {
+            m_epoch.wait(seen, std::memory_order_acquire);
+            seen = m_epoch.load(std::memory_order_acquire);
+            if(m_stop)
+                return;
+
+            for(uint64_t s = w; s < m_shards.size(); s += owners)
+                (*m_job)(s);
+            if(m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                m_pending.notify_one();
+        }
+    }
+
+    // a counting sort of key indices by shard.
+    void route(const uint64_t* keys, size_t n) {
+        m_route.resize(n);
+        m_order.resize(n);
+        m_start.assign(m_shards.size() + 1, 0);
+
+        for(size_t i = 0; i < n; ++i) {
+            m_route[i] = shard_of(keys[i]);
+            ++m_start[m_route[i] + 1];
+        }
+        for(uint64_t s = 0; s < m_shards.size(); ++s)
+            m_start[s + 1] += m_start[s];
+
+        std::vector<uint64_t> next(m_start.begin(), m_start.end() - 1);
+        for(size_t i = 0; i < n; ++i)
+            m_order[next[m_route[i]]++] = i;
+    }
+};
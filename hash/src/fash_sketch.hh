@@ -0,0 +1,176 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "fash.hh"
+
+// fash_count_min: a count-min sketch with 8 rows of 2^bit_size 32-bit
+// counters. a key's 8 row hashes are one vector H mix of the key xored with 8
+// row salts, one hash per 64-bit lane, so the rows are independent and all 8
+// positions cost one mix; one gather reads the counters and one scatter writes
+// them back. (double hashing, column h1 + r * h2 from a single hash, is
+// cheaper but makes two keys that agree on h1 and h2 mod the width collide in
+// every row at once, which at small widths puts the worst overcount far past
+// the bound.) the estimate is the smallest of the 8, which never undercounts
+// and overcounts by at most e * total / width with probability 1 - e^-8.
+//
+// add_batch updates two keys (16 counters) per gather/scatter. lanes r and
+// 8 + r are the same row, so if the two keys share that row's counter,
+// _mm512_conflict_epi32 flags the second lane; it adds 2 to the shared old
+// value and, written last by the scatter, is the one that lands. the other
+// lanes can't collide, since they are different rows.
+template <class H = fash_mix_hash>
+class fash_count_min {
+    uint32_t* __restrict m_counts;
+    unsigned char m_bitsz;
+    uint32_t m_width;
+    uint64_t m_total = 0;
+
+public:
+    static constexpr unsigned int rows = 8;
+
+    fash_count_min(unsigned char bit_size) : m_bitsz(bit_size), m_width(1u << bit_size) {
+        m_counts = fash_zalloc<uint32_t>(uint64_t(rows) << m_bitsz);
+    }
+
+    ~fash_count_min() {
+        fash_free(m_counts, uint64_t(rows) << m_bitsz);
+    }
+
+    fash_count_min(const fash_count_min &) = delete;
+    fash_count_min & operator=(const fash_count_min &) = delete;
+
+    inline __attribute__((always_inline)) void add(const uint64_t & key, uint32_t count = 1) {
+        const auto idx = positions(key);
+        const auto old = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_counts), idx, 4);
+        _mm256_i32scatter_epi32(m_counts, idx, _mm256_add_epi32(old, _mm256_set1_epi32(count)), 4);
+        m_total += count;
+    }
+
+    inline __attribute__((always_inline)) uint32_t estimate(const uint64_t & key) const {
+        auto v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(m_counts), positions(key), 4);
+        v = _mm256_min_epu32(v, _mm256_permute2x128_si256(v, v, 1));
+        v = _mm256_min_epu32(v, _mm256_shuffle_epi32(v, 0x4E));
+        v = _mm256_min_epu32(v, _mm256_shuffle_epi32(v, 0xB1));
+        return _mm256_cvtsi256_si32(v);
+    }
+
+    // add(keys[i]) for i in [0, n).
+    void add_batch(const uint64_t* keys, size_t n) {
+        for(size_t i = 0; i < n; i += 2) {
+            const __mmask16 live = i + 1 < n ? 0xFFFF : 0x00FF;
+            const auto idx = _mm512_inserti64x4(_mm512_castsi256_si512(positions(keys[i])), positions(i + 1 < n ? keys[i + 1] : 0), 1);
+            const auto conf = _mm512_maskz_conflict_epi32(live, idx);
+            const auto inc = _mm512_mask_blend_epi32(_mm512_test_epi32_mask(conf, conf), _mm512_set1_epi32(1), _mm512_set1_epi32(2));
+            const auto old = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), live, idx, m_counts, 4);
+            _mm512_mask_i32scatter_epi32(m_counts, live, idx, _mm512_add_epi32(old, inc), 4);
+        }
+        m_total += n;
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint32_t width() const { return m_width; }
+    uint64_t total() const { return m_total; }
+    uint64_t bytes() const { return (uint64_t(rows) << m_bitsz) * sizeof(uint32_t); }
+
+private:
+    // row r's counter for key, as an index into m_counts, in lane r.
+    inline __attribute__((always_inline)) __m256i positions(uint64_t key) const {
+        const auto salt = _mm512_setr_epi64(0x47b6137b44974d91, 0x8824ad5ba2b7289d, 0x705495c72df1424b, 0x9efc49475c6bfb31,
+                                            0x5c6bfb31d3a2b75d, 0xa2b7289d9efc4947, 0x2df1424b8824ad5b, 0x44974d91705495c7);
+        const auto col = _mm512_cvtepi64_epi32(H{}(_mm512_xor_epi64(_mm512_set1_epi64(key), salt)));
+        const auto r = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        return _mm256_add_epi32(_mm256_and_si256(col, _mm256_set1_epi32(m_width - 1)), _mm256_slli_epi32(r, m_bitsz));
+    }
+};
+
+// fash_heavy_hitters: a fash_count_min plus the k keys with the highest
+// estimates seen so far. after every update the key's estimate is compared
+// with the smallest tracked one (the floor) and most keys stop there; a key
+// that clears it is looked for among the tracked keys, 8 per compare, and
+// either refreshes its estimate or takes the floor's slot. estimates only
+// grow, so a tracked key only leaves when a hotter one displaces it.
+//
+// keys are 64-bit and 0 is reserved, as in fash.
+template <class H = fash_mix_hash>
+class fash_heavy_hitters {
+    fash_count_min<H> m_sketch;
+    std::vector<uint64_t> m_keys;       // k rounded up to 8, 0 = free
+    std::vector<uint32_t> m_est;
+    unsigned int m_k;
+    unsigned int m_tracked = 0;
+    unsigned int m_floor_at = 0;
+    uint32_t m_floor = 0;
+
+public:
+    fash_heavy_hitters(unsigned char bit_size, unsigned int k) : m_sketch(bit_size), m_keys((k + 7) & ~7u), m_est((k + 7) & ~7u), m_k(k) {
+        if(k == 0)
+            throw std::invalid_argument("fash_heavy_hitters: k must be at least 1");
+    }
+
+    inline __attribute__((always_inline)) void add(const uint64_t & key) {
+        m_sketch.add(key);
+        offer(key, m_sketch.estimate(key));
+    }
+
+    void add_batch(const uint64_t* keys, size_t n) {
+        m_sketch.add_batch(keys, n);
+        for(size_t i = 0; i < n; ++i)
+            offer(keys[i], m_sketch.estimate(keys[i]));
+    }
+
+    // the tracked keys and their estimates, hottest first.
+    std::vector<std::pair<uint64_t, uint32_t>> top() const {
+        std::vector<std::pair<uint64_t, uint32_t>> out;
+        for(size_t i = 0; i < m_keys.size(); ++i)
+            if(m_keys[i])
+                out.emplace_back(m_keys[i], m_est[i]);
+        std::sort(out.begin(), out.end(), [](const auto & a, const auto & b) { return a.second > b.second; });
+        return out;
+    }
+
+    const fash_count_min<H> & sketch() const { return m_sketch; }
+    uint64_t bytes() const { return m_sketch.bytes() + m_keys.size() * (sizeof(uint64_t) + sizeof(uint32_t)); }
+
+private:
+    inline __attribute__((always_inline)) void offer(const uint64_t & key, uint32_t est) {
+        if(m_tracked == m_k && est <= m_floor)
+            return;
+
+        const auto kk = _mm512_set1_epi64(key);
+        for(size_t i = 0; i < m_keys.size(); i += 8) {
+            const unsigned int hit = _mm512_cmpeq_epi64_mask(kk, _mm512_loadu_epi64(m_keys.data() + i));
+            if(hit) {
+                m_est[i + __builtin_ctz(hit)] = est;
+                if(m_tracked == m_k && i + __builtin_ctz(hit) == m_floor_at)
+                    refloor();
+                return;
+            }
+        }
+
+        if(m_tracked < m_k) {
+            const size_t slot = std::find(m_keys.begin(), m_keys.end(), 0) - m_keys.begin();
+            m_keys[slot] = key;
+            m_est[slot] = est;
+            if(++m_tracked == m_k)
+                refloor();
+            return;
+        }
+
+        m_keys[m_floor_at] = key;
+        m_est[m_floor_at] = est;
+        refloor();
+    }
+
+    void refloor() {
+        m_floor_at = 0;
+        for(unsigned int i = 1; i < m_keys.size(); ++i)
+            if(m_keys[i] && (!m_keys[m_floor_at] || m_est[i] < m_est[m_floor_at]))
+                m_floor_at = i;
+        m_floor = m_est[m_floor_at];
+    }
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "fash.hh"
+
+// fash_symbol: a string of up to 32 bytes (OCC option symbols are 21, tickers
+// fewer) stored zero padded in one 32-byte block, so every symbol hashes and
+// compares as 4 words no matter its length. symbols can't contain NULs.
+struct alignas(32) fash_symbol {
+    char bytes[32] = {};
+
+    fash_symbol() = default;
+
+    explicit fash_symbol(std::string_view s) {
+        if(s.size() > sizeof(bytes))
+            throw std::length_error("fash_symbol: longer than 32 bytes");
+        memcpy(bytes, s.data(), s.size());
+    }
+
+    bool operator==(const fash_symbol & o) const {
+        const auto a = _mm256_load_si256(reinterpret_cast<const __m256i*>(bytes));
+        const auto b = _mm256_load_si256(reinterpret_cast<const __m256i*>(o.bytes));
+        return _mm256_cmpeq_epi64_mask(a, b) == 0xF;
+    }
+
+    std::string_view view() const { return std::string_view(bytes, strnlen(bytes, sizeof(bytes))); }
+};
+
+// fash_symbol_hash: the symbol's 4 words chained through H, h = H(h ^ word),
+// which is H applied 4 times. the __m512i form takes 8 symbols from an array
+// of fash_symbol, one per lane: word w of every lane is a single gather at a
+// 32-byte stride, so the 8 chains run side by side and agree lane for lane
+// with the scalar form. 0 is mapped to 1, since fash keeps 0 for empty slots.
+template <class H = fash_mix_hash>
+struct fash_symbol_hash {
+    inline __attribute__((always_inline)) uint64_t operator()(const fash_symbol & s) const {
+        uint64_t w[4];
+        memcpy(w, s.bytes, sizeof(w));
+        uint64_t h = 0x2545f4914f6cdd1dULL;
+        for(int i = 0; i < 4; ++i)
+            h = H{}(h ^ w[i]);
+        return h ? h : 1;
+    }
+
+    inline __attribute__((always_inline)) __m512i operator()(const fash_symbol* s, __mmask8 live = 0xFF) const {
+        const auto idx = _mm512_setr_epi64(0, 4, 8, 12, 16, 20, 24, 28);
+        const long long* base = reinterpret_cast<const long long*>(s);
+        auto h = _mm512_set1_epi64(0x2545f4914f6cdd1dULL);
+        for(int i = 0; i < 4; ++i)
+            h = H{}(_mm512_xor_epi64(h, _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), live, _mm512_add_epi64(idx, _mm512_set1_epi64(i)), base, 8)));
+        return _mm512_mask_mov_epi64(h, _mm512_cmpeq_epi64_mask(h, _mm512_setzero_si512()), _mm512_set1_epi64(1));
+    }
+};
+
+// fash_symbols: symbol -> V on a fash keyed by the symbol's 64-bit hash (with
+// the fash_prehashed policy, so the hash isn't mixed twice). this is the
+// equality rule in fash.hh's header comment: two symbols are the same if their
+// hashes are, which at a million symbols is wrong about once in 4 * 10^7 tables.
+//
+// Verify = true keeps the symbols themselves in a side array, next to the
+// values, and the fash maps the hash to a row in both. a lookup then confirms
+// the symbol with one 32-byte compare, so a symbol outside the set that shares
+// a member's hash is turned away, and an insert whose hash is already taken by
+// a different symbol throws std::runtime_error rather than aliasing it.
+//
+// find and at point at the stored value, and like a vector's references they
+// are invalidated by the next insert: with Verify the values live in a
+// std::vector that may reallocate, and without it a value in the fash's stash
+// moves when the stash grows. copy the value out if an insert may come between.
+template <class V, bool Verify = false, class H = fash_mix_hash>
+class fash_symbols {
+    using slot_type = std::conditional_t<Verify, uint32_t, V>;
+    static constexpr size_t chunk = 64;
+
+    fash<uint64_t, slot_type, fash_prehashed> m_table;
+    std::vector<V> m_values;            // Verify only: row -> value
+    std::vector<fash_symbol> m_symbols; // Verify only: row -> symbol
+    uint64_t m_size = 0;
+
+public:
+    using key_type = fash_symbol;
+    using value_type = V;
+
+    fash_symbols(unsigned char bit_size) : m_table(bit_size) {
+    }
+
+    // false (and the stored value untouched) if the symbol is already there.
+    bool insert(std::string_view key, V value) {
+        const fash_symbol s(key);
+        const uint64_t h = fash_symbol_hash<H>{}(s);
+        slot_type* found = m_table.find_int64(h);
+        if(found) {
+            if constexpr(Verify)
+                if(!(m_symbols[*found] == s))
+                    throw std::runtime_error("fash_symbols: 64-bit hash collision");
+            return false;
+        }
+
+        if constexpr(Verify) {
+            m_table.insert_no_intrinsic_int64(h, m_symbols.size());
+            m_symbols.push_back(s);
+            m_values.push_back(value);
+        } else {
+            m_table.insert_no_intrinsic_int64(h, value);
+        }
+        ++m_size;
+        return true;
+    }
+
+    // valid until the next insert.
+    inline __attribute__((always_inline)) V * find(const fash_symbol & key) {
+        return resolve(key, m_table.find_int64(fash_symbol_hash<H>{}(key)));
+    }
+
+    V * find(std::string_view key) {
+        return key.size() > sizeof(fash_symbol::bytes) ? nullptr : find(fash_symbol(key));
+    }
+
+    V & at(std::string_view key) {
+        auto found = find(key);
+        if(!found)
+            throw std::out_of_range("fash_symbols::at");
+        return *found;
+    }
+
+    // as fash128x::at_batch, for a column of symbols: hashes 8 per call, and
+    // every bucket of a 64 symbol chunk is prefetched before the first lookup.
+    size_t at_batch(const fash_symbol* keys, size_t n, V* out, unsigned char* found = nullptr) {
+        alignas(64) uint64_t h[chunk];
+        size_t misses = 0;
+
+        for(size_t base = 0; base < n; base += chunk) {
+            const size_t len = std::min(chunk, n - base);
+            for(size_t j = 0; j < len; j += 8) {
+                const __mmask8 live = len - j >= 8 ? 0xFF : (1u << (len - j)) - 1;
+                _mm512_store_epi64(h + j, fash_symbol_hash<H>{}(keys + base + j, live));
+            }
+            for(size_t j = 0; j < len; ++j)
+                m_table.prefetch_bucket(m_table.bucket_of(h[j]));
+
+            for(size_t j = 0; j < len; ++j) {
+                V* hit = resolve(keys[base + j], m_table.find_int64(h[j]));
+                if(hit)
+                    out[base + j] = *hit;
+                else
+                    ++misses;
+                if(found)
+                    found[base + j] = hit != nullptr;
+            }
+        }
+
+        return misses;
+    }
+
+    // the same for strings, padded into fash_symbols a chunk at a time.
+    // strings longer than 32 bytes are misses.
+    size_t at_batch(const std::string_view* keys, size_t n, V* out, unsigned char* found = nullptr) {
+        fash_symbol padded[chunk];
+        V hits[chunk];
+        unsigned char ok[chunk];
+        size_t misses = 0;
+
+        for(size_t base = 0; base < n; base += chunk) {
+            const size_t len = std::min(chunk, n - base);
+            for(size_t j = 0; j < len; ++j) {
+                const auto & s = keys[base + j];
+                padded[j] = fash_symbol();
+                memcpy(padded[j].bytes, s.data(), std::min(s.size(), sizeof(fash_symbol::bytes)));
+            }
+            at_batch(padded, len, hits, ok);
+
+            for(size_t j = 0; j < len; ++j) {
+                ok[j] &= keys[base + j].size() <= sizeof(fash_symbol::bytes);
+                if(ok[j])
+                    out[base + j] = hits[j];
+                else
+                    ++misses;
+                if(found)
+                    found[base + j] = ok[j];
+            }
+        }
+
+        return misses;
+    }
+
+    uint64_t size() const { return m_size; }
+    unsigned char bit_size() const { return m_table.bit_size(); }
+    uint64_t stash_size() const { return m_table.stash_size(); }
+
+private:
+    inline __attribute__((always_inline)) V * resolve(const fash_symbol & key, slot_type* found) {
+        if constexpr(Verify) {
+            if(!found || !(m_symbols[*found] == key))
+                return nullptr;
+            return &m_values[*found];
+        } else {
+            return found;
+        }
+    }
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <immintrin.h>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "fash.hh"
+
+// fash_table: the fash, fash2, fash128x and fash128x2 designs as one template,
+// so the layout can be picked per workload instead of per class.
+//
+//   - Layout: fash_soa keeps keys and values in parallel arrays (fash,
+//     fash128x), fash_aos interleaves them as fash_kvp (fash2, fash128x2).
+//     either way a probe compares 8 keys at once; aos pulls them out of two
+//     lines with a permute (or a gather, for values that aren't 8 bytes).
+//   - W: slots per bucket, a power of two of at least 8.
+//   - Probe: fash_probe_scan starts every key at slot 0 of its bucket (fash),
+//     fash_probe_guess starts at the 8 slot line picked by the top hash bits
+//     (fash128x), so a wide bucket isn't scanned from the front every time.
+//
+// sizing follows fash128x: bit_size is the nominal capacity 2^bit_size, and the
+// table has twice that many slots, so every combination uses the same memory
+// for the same bit_size. keys whose bucket is full go to a stash as in fash.
+//
+// probing is linear within the bucket, wrapping at its end, and a probe stops at
+// the first line holding an empty slot. erase keeps that true by moving later
+// keys back into the hole (a plain swap-with-last for fash_probe_scan, where
+// every key starts at the same slot), so there are no tombstones.
+struct fash_soa {};
+struct fash_aos {};
+
+struct fash_probe_scan {};
+struct fash_probe_guess {};
+
+template <class Layout, class V>
+class fash_slots;
+
+template <class V>
+class fash_slots<fash_soa, V> {
+    uint64_t* __restrict m_key;
+    V* __restrict m_value;
+    uint64_t m_n;
+
+public:
+    fash_slots(uint64_t n) {
+        m_n = n;
+        m_key = fash_zalloc<uint64_t>(n);
+        m_value = fash_zalloc<V>(n);
+    }
+
+    ~fash_slots() {
+        fash_free(m_key, m_n);
+        fash_free(m_value, m_n);
+    }
+
+    inline __attribute__((always_inline)) uint64_t & key(uint64_t i) { return m_key[i]; }
+    inline __attribute__((always_inline)) V & value(uint64_t i) { return m_value[i]; }
+    inline __attribute__((always_inline)) __m512i keys8(uint64_t i) const { return _mm512_load_epi64(m_key + i); }
+
+    inline __attribute__((always_inline)) void prefetch(uint64_t i) const {
+        __builtin_prefetch(m_key + i);
+        __builtin_prefetch(m_value + i);
+    }
+};
+
+template <class V>
+class fash_slots<fash_aos, V> {
+    fash_kvp<V>* __restrict m_kv;
+    uint64_t m_n;
+
+    static constexpr long long stride = sizeof(fash_kvp<V>) / 8;
+
+public:
+    fash_slots(uint64_t n) {
+        m_n = n;
+        m_kv = fash_zalloc<fash_kvp<V>>(n);
+    }
+
+    ~fash_slots() {
+        fash_free(m_kv, m_n);
+    }
+
+    inline __attribute__((always_inline)) uint64_t & key(uint64_t i) { return m_kv[i].key; }
+    inline __attribute__((always_inline)) V & value(uint64_t i) { return m_kv[i].value; }
+
+    // i is a multiple of 8, so for 16 byte pairs the 8 keys are the even
+    // qwords of two aligned 64-byte loads.
+    inline __attribute__((always_inline)) __m512i keys8(uint64_t i) const {
+        if constexpr (stride == 2) {
+            const auto lo = _mm512_load_epi64(m_kv + i);
+            const auto hi = _mm512_load_epi64(m_kv + i + 4);
+            return _mm512_permutex2var_epi64(lo, _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14), hi);
+        } else {
+            const auto idx = _mm512_setr_epi64(0, stride, 2 * stride, 3 * stride, 4 * stride, 5 * stride, 6 * stride, 7 * stride);
+            return _mm512_i64gather_epi64(idx, &m_kv[i].key, 8);
+        }
+    }
+
+    inline __attribute__((always_inline)) void prefetch(uint64_t i) const {
+        __builtin_prefetch(m_kv + i);
+    }
+};
+
+template <class K, class V, class Layout = fash_soa, unsigned int W = 16, class Probe = fash_probe_scan, class H = fash_mix_hash>
+class fash_table {
+    static_assert(W >= 8 && (W & (W - 1)) == 0, "bucket width must be a power of two of at least 8 slots");
+    static_assert(std::is_same_v<Layout, fash_soa> || std::is_same_v<Layout, fash_aos>, "layout is fash_soa or fash_aos");
+    static_assert(std::is_same_v<Probe, fash_probe_scan> || std::is_same_v<Probe, fash_probe_guess>, "probe is fash_probe_scan or fash_probe_guess");
+
+    static constexpr unsigned int wshift = __builtin_ctz(W);
+    static constexpr unsigned int lshift = wshift - 3;   // log2 of 8 slot lines per bucket
+    static constexpr bool guess = std::is_same_v<Probe, fash_probe_guess> && lshift > 0;
+
+    // locate's answers when the key isn't in its bucket: the probe hit an empty
+    // slot, or it went round the whole (full) bucket and the key may be stashed.
+    static constexpr uint64_t npos = ~0ULL;
+    static constexpr uint64_t full = ~0ULL - 1;
+
+    fash_slots<Layout, V> m_slots;
+    unsigned char m_bitsz;
+    uint64_t m_sz, m_sz_m1;
+    __m512i m_vz_m1;
+    fash_stash<V> m_stash;
+    uint64_t m_overflows = 0;
+
+public:
+    using key_type = K;
+    using value_type = V;
+
+    fash_table(unsigned char bit_size) : m_slots(slots_for(bit_size)) {
+        m_bitsz = bit_size;
+        m_sz = slots_for(bit_size);
+        m_sz_m1 = (m_sz >> wshift) - 1;
+        m_vz_m1 = _mm512_set1_epi64(m_sz_m1);
+    }
+
+    fash_table(const fash_table &) = delete;
+    fash_table & operator=(const fash_table &) = delete;
+
+    inline __attribute__((always_inline)) V * find_int64(const uint64_t & key) {
+        return find_from(key, home_of(unhash(key)));
+    }
+
+    inline __attribute__((always_inline)) V & at_int64(const uint64_t & key) {
+        auto found = find_int64(key);
+        if(!found)
+            throw std::out_of_range("fash_table::at_int64");
+        return *found;
+    }
+
+    bool contains_int64(const uint64_t & key) {
+        return find_int64(key) != nullptr;
+    }
+
+    // inserts key unless it's already there, in which case it returns false and
+    // leaves the stored value alone. a full bucket sends the key to the stash.
+    bool insert_int64(const uint64_t & key, V data) {
+        return insert_from(key, data, home_of(unhash(key)));
+    }
+
+    // no duplicate check and no stash: false means the bucket is full. this is
+    // what fash_growable calls before deciding to grow.
+    bool try_insert_int64(const uint64_t & key, V data) {
+        const auto slot = open_slot(home_of(unhash(key)));
+        if(slot == full)
+            return false;
+
+        m_slots.key(slot) = key;
+        m_slots.value(slot) = data;
+        return true;
+    }
+
+    bool erase_int64(const uint64_t & key) {
+        const auto home = home_of(unhash(key));
+        const auto slot = locate(key, home);
+        if(slot == npos)
+            return false;
+        if(slot == full)
+            return m_stash.size() && m_stash.erase(key);
+
+        const uint64_t bucket = home & ~uint64_t(W - 1);
+        bool was_full;
+
+        if constexpr (!guess) {
+            // every key starts at slot 0, so the bucket is a packed prefix.
+            uint64_t last = bucket + W - 1;
+            for(unsigned int i = 0; i < W; i += 8) {
+                unsigned short open = _mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), m_slots.keys8(bucket + i));
+                if(open) {
+                    last = bucket + i + __builtin_ctz(open) - 1;
+                    break;
+                }
+            }
+            was_full = last == bucket + W - 1;
+            m_slots.key(slot) = m_slots.key(last);
+            m_slots.value(slot) = m_slots.value(last);
+            m_slots.key(last) = 0;
+        } else {
+            // backward shift: a later key moves into the hole if the hole lies
+            // on its probe path, i.e. between its start line and where it is.
+            uint64_t hole = slot;
+            uint64_t j = slot;
+            was_full = true;
+            for(unsigned int n = 1; n < W; ++n) {
+                j = bucket + ((j + 1) & (W - 1));
+                const uint64_t kj = m_slots.key(j);
+                if(kj == 0) {
+                    was_full = false;
+                    break;
+                }
+
+                const uint64_t h = home_of(unhash(kj));
+                if(((hole - h) & (W - 1)) < ((j - h) & (W - 1))) {
+                    m_slots.key(hole) = kj;
+                    m_slots.value(hole) = m_slots.value(j);
+                    hole = j;
+                }
+            }
+            m_slots.key(hole) = 0;
+        }
+
+        if(was_full && m_stash.size())
+            unstash(bucket >> wshift);
+        return true;
+    }
+
+    // resolves n keys at once, prefetching the start line of key i + distance
+    // while key i is probed, as fash128x::at_batch. misses leave out[i] alone;
+    // found (if given) gets a 0/1 per key, and the return value is the number
+    // of misses.
+    size_t at_batch(const uint64_t* keys, size_t n, V* out, unsigned char* found = nullptr, unsigned int distance = 32) {
+        uint64_t ring[batch_ring];
+        distance = std::min((distance + 7) & ~7u, batch_ring - 8);
+        size_t misses = 0;
+        size_t staged = 0;
+
+        for(; staged < n && staged < distance; staged += 8)
+            batch_stage(keys, n, staged, ring);
+
+        for(size_t i = 0; i < n; i += 8) {
+            if(staged < n) {
+                batch_stage(keys, n, staged, ring);
+                staged += 8;
+            }
+
+            const size_t end = std::min(i + 8, n);
+            for(size_t j = i; j < end; ++j) {
+                V* hit = find_from(keys[j], ring[j & (batch_ring - 1)]);
+                if(hit)
+                    out[j] = *hit;
+                else
+                    ++misses;
+                if(found)
+                    found[j] = hit != nullptr;
+            }
+        }
+
+        return misses;
+    }
+
+    // insert_int64 over n keys with the same lookahead as at_batch: keys are
+    // hashed 8 at a time and inserted from the start slots staged in the ring.
+    // returns the number of keys that were already present.
+    size_t insert_batch(const uint64_t* keys, const V* values, size_t n, unsigned int distance = 32) {
+        uint64_t ring[batch_ring];
+        distance = std::min((distance + 7) & ~7u, batch_ring - 8);
+        size_t duplicates = 0;
+        size_t staged = 0;
+
+        for(; staged < n && staged < distance; staged += 8)
+            batch_stage(keys, n, staged, ring);
+
+        for(size_t i = 0; i < n; i += 8) {
+            if(staged < n) {
+                batch_stage(keys, n, staged, ring);
+                staged += 8;
+            }
+
+            const size_t end = std::min(i + 8, n);
+            for(size_t j = i; j < end; ++j)
+                duplicates += !insert_from(keys[j], values[j], ring[j & (batch_ring - 1)]);
+        }
+
+        return duplicates;
+    }
+
+    // hands every live entry of bucket b to f(key, value) and empties the bucket.
+    template <class F>
+    void drain_bucket(uint64_t b, F && f) {
+        const uint64_t bucket = b << wshift;
+        for(unsigned int i = 0; i < W; ++i) {
+            if(m_slots.key(bucket + i)) {
+                f(m_slots.key(bucket + i), m_slots.value(bucket + i));
+                m_slots.key(bucket + i) = 0;
+            }
+        }
+
+        if(m_stash.size())
+            m_stash.drain_if([this, b](const uint64_t & key) { return bucket_of(key) == b; }, f);
+    }
+
+    unsigned char bit_size() const { return m_bitsz; }
+    uint64_t nominal_size() const { return 1ULL << m_bitsz; }
+    uint64_t bucket_count() const { return m_sz_m1 + 1; }
+    uint64_t bucket_of(const uint64_t & key) const { return unhash(key) & m_sz_m1; }
+    uint64_t slot_count() const { return m_sz; }
+
+    uint64_t stash_size() const { return m_stash.size(); }
+    uint64_t stash_capacity() const { return m_stash.capacity(); }
+    uint64_t overflow_count() const { return m_overflows; }
+
+    inline __attribute__((always_inline)) uint64_t unhash(uint64_t x) const {
+        return H{}(x);
+    }
+
+    inline __attribute__((always_inline)) __m512i unhash(__m512i x) const {
+        return H{}(x);
+    }
+
+private:
+    static constexpr unsigned int batch_ring = 256;
+
+    static uint64_t slots_for(unsigned char bit_size) {
+        return std::max<uint64_t>(2ULL << bit_size, W);
+    }
+
+    // the slot a key's probe starts at: its bucket, plus for fash_probe_guess
+    // the line named by the top hash bits (the bucket index uses the low ones).
+    inline __attribute__((always_inline)) uint64_t home_of(uint64_t k) const {
+        uint64_t home = (k & m_sz_m1) << wshift;
+        if constexpr (guess)
+            home += (k >> (64 - lshift)) << 3;
+        return home;
+    }
+
+    inline __attribute__((always_inline)) uint64_t locate(const uint64_t & key, uint64_t home) const {
+        const auto kk = _mm512_set1_epi64(key);
+        const uint64_t bucket = home & ~uint64_t(W - 1);
+
+        for(unsigned int i = 0; i < W; i += 8) {
+            const auto slot = bucket + ((home + i) & (W - 1));
+            const auto b = m_slots.keys8(slot);
+            unsigned short mask = _mm512_cmpeq_epi64_mask(kk, b);
+            if(mask)
+                return slot + __builtin_ctz(mask);
+            if(_mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), b))
+                return npos;
+        }
+
+        return full;
+    }
+
+    inline __attribute__((always_inline)) V * find_from(const uint64_t & key, uint64_t home) {
+        const auto slot = locate(key, home);
+        if(slot < full) [[likely]]
+            return &m_slots.value(slot);
+        return slot == full && m_stash.size() ? m_stash.find(key) : nullptr;
+    }
+
+    // insert_int64 for a key whose start slot is already known.
+    inline __attribute__((always_inline)) bool insert_from(const uint64_t & key, V data, uint64_t home) {
+        const auto kk = _mm512_set1_epi64(key);
+        const uint64_t bucket = home & ~uint64_t(W - 1);
+
+        for(unsigned int i = 0; i < W; i += 8) {
+            const auto slot = bucket + ((home + i) & (W - 1));
+            const auto b = m_slots.keys8(slot);
+            if(_mm512_cmpeq_epi64_mask(kk, b))
+                return false;
+
+            unsigned short open = _mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), b);
+            if(open) {
+                m_slots.key(slot + __builtin_ctz(open)) = key;
+                m_slots.value(slot + __builtin_ctz(open)) = data;
+                return true;
+            }
+        }
+
+        if(m_stash.size() && m_stash.contains(key))
+            return false;
+
+        m_stash.push(key, data);
+        ++m_overflows;
+        return true;
+    }
+
+    inline __attribute__((always_inline)) uint64_t open_slot(uint64_t home) const {
+        const uint64_t bucket = home & ~uint64_t(W - 1);
+
+        for(unsigned int i = 0; i < W; i += 8) {
+            const auto slot = bucket + ((home + i) & (W - 1));
+            unsigned short open = _mm512_cmpeq_epi64_mask(_mm512_setzero_si512(), m_slots.keys8(slot));
+            if(open)
+                return slot + __builtin_ctz(open);
+        }
+
+        return full;
+    }
+
+    // a slot just opened up in full bucket b: the first stashed key that
+    // belongs there takes it.
+    void unstash(uint64_t b) {
+        bool moved = false;
+        m_stash.drain_if([this, b, &moved](const uint64_t & key) { return !moved && bucket_of(key) == b; },
+                         [this, &moved](const uint64_t & key, V & value) {
+                             const auto slot = open_slot(home_of(unhash(key)));
+                             m_slots.key(slot) = key;
+                             m_slots.value(slot) = value;
+                             moved = true;
+                         });
+    }
+
+    // hashes keys[j, j+8), stores their start slots in the ring and prefetches
+    // the lines they start on.
+    inline __attribute__((always_inline)) void batch_stage(const uint64_t* keys, size_t n, size_t j, uint64_t* ring) {
+        const __mmask8 live = n - j >= 8 ? 0xFF : (1 << (n - j)) - 1;
+        const auto k = unhash(_mm512_maskz_loadu_epi64(live, keys + j));
+        auto home = _mm512_slli_epi64(_mm512_and_epi64(k, m_vz_m1), wshift);
+        if constexpr (guess)
+            home = _mm512_add_epi64(home, _mm512_slli_epi64(_mm512_srli_epi64(k, 64 - lshift), 3));
+        uint64_t* idx = ring + (j & (batch_ring - 1));
+        _mm512_storeu_epi64(idx, home);
+
+        for(int l = 0; l < 8; ++l)
+            m_slots.prefetch(idx[l]);
+    }
+};
@@ -3,17 +3,45 @@
 #include <benchmark/benchmark.h>
 #include <iostream>
 #include <unordered_map>
+#include <limits>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <new>
 #include <string>
+#include <thread>
 #include <vector>
 #include <assert.h> 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "fash.hh"
+#include "fash_concurrent.hh"
+#include "fash_table.hh"
+#include "fash_bloom.hh"
+#include "fash_cuckoo.hh"
+#include "fash_cache.hh"
+#include "fash_sharded.hh"
+#include "fash_join.hh"
+#include "fash_groupby.hh"
+#include "fash_mph.hh"
+#include "fash_symbols.hh"
+#include "fash_sketch.hh"
+#include "fash_rcu.hh"
 
 //#define ARGS ->Args({8})->Args({10})->Args({11})->Args({12})->Args({13})->Args({14})->Args({15})->Args({16})->Args({18})->Args({20});
 #define ARGS ->Args({10})->Args({11})->Args({12})->Args({13})->Args({14})->Args({15})->Args({16})->Args({17})->Args({18})->Args({19})->Args({20})->Args({21})->Args({22})->Args({23})->Args({24})->Args({25})->Args({26});
 //#define ARGS ->Args({20});
+#define BATCH_ARGS ->ArgsProduct({benchmark::CreateDenseRange(10, 26, 1), {32}});
+#define BATCH_DISTANCE_ARGS ->ArgsProduct({{20, 23, 26}, {0, 8, 16, 32, 64, 128}});
+#define GROW_ARGS ->Args({16})->Args({18})->Args({20})->Args({22})->Unit(benchmark::kMillisecond)->Iterations(3);
 
 #define LOOKUPCOUNT 731
 
@@ -31,8 +59,6 @@ struct Point {
     }
 };
 
-struct Empty {};
-
 static void fash2_at_bmk(benchmark::State &state) {
     auto bits  = state.range(0);
     auto n = 1 << bits;
@@ -187,6 +213,340 @@ static void fash_at_intr_bmk(benchmark::State &state) {
 BENCHMARK(fash_at_intr_bmk)ARGS
 
 
+// steady state churn over a sliding window of 2^bits live keys: every step
+// erases the oldest key, inserts a new one and looks up one from mid-window.
+static void fash_churn_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+    uint64_t next = n;
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            table.erase_int64(next - n + (1<<20));
+            table.insert_no_intrinsic_int64(next + (1<<20), next);
+            auto found = table.at_int64(next - n/2 + (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+            ++next;
+        }
+    }
+
+    assert(table.at_no_intrinsic_int64(next - 1 + (1<<20)) == next - 1);
+    assert(table.find_int64(next - n + (1<<19)) == nullptr);
+}
+BENCHMARK(fash_churn_bmk)ARGS
+
+// the fash_at_intr_bmk workload, run after the table has been churned through
+// 16 full windows of erase/insert. should match fash_at_intr_bmk.
+static void fash_churned_at_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+    uint64_t next = n;
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for(uint64_t i = 0; i < 16ULL * n; ++i, ++next) {
+        table.erase_int64(next - n + (1<<20));
+        table.insert_no_intrinsic_int64(next + (1<<20), next);
+    }
+
+    for (auto _ : state)
+    {
+        for(uint64_t i = next - n; i < next; i++)  {
+            auto found = table.at_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.at_no_intrinsic_int64(next - 41 + (1<<20)) == next - 41);
+}
+BENCHMARK(fash_churned_at_bmk)ARGS
+
+// keys that all land in bucket 0 of any fash, for 64 more keys than a bucket
+// holds. unhash is a bijection, so these come from running it backwards on
+// hashes whose low 32 bits are zero.
+static uint64_t inverse_xorshift(uint64_t y, int a, int b) {
+    uint64_t x = y;
+    for(int i = 0; i < 64 / a + 1; ++i)
+        x = y ^ (x >> a) ^ (x >> b);
+    return x;
+}
+
+static uint64_t inverse_odd(uint64_t c) {
+    uint64_t inv = c;
+    for(int i = 0; i < 6; ++i)
+        inv *= 2 - c * inv;
+    return inv;
+}
+
+static std::vector<uint64_t> clustered_keys(int count) {
+    std::vector<uint64_t> keys(count);
+    for(int j = 0; j < count; ++j) {
+        uint64_t x = inverse_xorshift(uint64_t(j + 1) << 32, 30, 60);
+        x = inverse_xorshift(x * inverse_odd(UINT64_C(0x96de1b173f119089)), 27, 54);
+        keys[j] = inverse_xorshift(x * inverse_odd(UINT64_C(0x319642b2d24d8ec3)), 31, 62);
+    }
+    return keys;
+}
+
+// the fash_at_intr_bmk workload on a table that also holds 80 keys piled into
+// one bucket, 64 of which live in the stash. only bucket 0 ever looks there.
+static void fash_stash_at_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+    auto clustered = clustered_keys(80);
+
+    for(auto key : clustered)
+        table.insert_no_intrinsic_int64(key, key);
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.at_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    for(auto key : clustered)
+        assert(table.at_int64(key) == key);
+    state.counters["stash_size"] = table.stash_size();
+    state.counters["overflows"] = table.overflow_count();
+}
+BENCHMARK(fash_stash_at_bmk)ARGS
+
+// lookups of the 80 clustered keys themselves: 16 hit the bucket, the rest
+// scan the stash.
+static void fash_stash_overflow_at_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+    auto clustered = clustered_keys(80);
+
+    for(auto key : clustered)
+        table.insert_no_intrinsic_int64(key, key);
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(auto key : clustered)  {
+            auto found = table.at_int64(key);
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    state.counters["stash_size"] = table.stash_size();
+    state.counters["overflows"] = table.overflow_count();
+
+    // erasing from the full bucket pulls stashed keys back into it.
+    for(auto key : clustered) {
+        [[maybe_unused]] const bool erased = table.erase_int64(key);
+        assert(erased);
+    }
+    assert(table.stash_size() == 0);
+    for(int i = 0; i < n; i++)
+        assert(table.at_int64(i+ (1<<20)) == uint64_t(i));
+}
+BENCHMARK(fash_stash_overflow_at_bmk)ARGS
+
+// table load time: the insert_no_intrinsic_int64 loop the lookup benchmarks
+// use, against insert_batch over the same key and value columns. the table is
+// emptied between iterations (untimed) so page faults don't swamp the inserts.
+static void fash_insert_loop_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    std::vector<uint64_t> keys(n), values(n);
+    for(int i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        values[i] = i;
+    }
+
+    fash<uint64_t, uint64_t> table(bits);
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; ++i) {
+            table.insert_no_intrinsic_int64(keys[i], values[i]);
+        }
+        benchmark::ClobberMemory();
+
+        state.PauseTiming();
+        for(int i = 0; i < n; ++i)
+            table.erase_int64(keys[i]);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(fash_insert_loop_bmk)ARGS
+
+static void fash_insert_batch_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    std::vector<uint64_t> keys(n), values(n);
+    for(int i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        values[i] = i;
+    }
+
+    fash<uint64_t, uint64_t> table(bits);
+    for (auto _ : state)
+    {
+        table.insert_batch(keys.data(), values.data(), n);
+        benchmark::ClobberMemory();
+
+        state.PauseTiming();
+        for(int i = 0; i < n; ++i)
+            table.erase_int64(keys[i]);
+        state.ResumeTiming();
+    }
+
+    auto clustered = clustered_keys(40);
+    table.insert_batch(clustered.data(), clustered.data(), clustered.size());
+    table.insert_batch(keys.data(), values.data(), n);
+    for(int i = 0; i < n; ++i)
+        assert(table.at_int64(keys[i]) == uint64_t(i));
+    for(auto key : clustered)
+        assert(table.at_int64(key) == key);
+}
+BENCHMARK(fash_insert_batch_bmk)ARGS
+
+// membership over keys i + 2^20 for i < 2^(bits+1): half hits, half misses.
+// the set against the same table carrying uint64_t values.
+static void fash_set_contains_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash_set<uint64_t> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_int64(i+ (1<<20));
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < 2 * n; i++)  {
+            auto found = table.contains_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.contains_int64(41 + (1<<20)));
+    [[maybe_unused]] const bool reinserted = table.insert_int64(41 + (1<<20));
+    [[maybe_unused]] const bool erased = table.erase_int64(41 + (1<<20));
+    assert(!reinserted && erased);
+    assert(!table.contains_int64(41 + (1<<20)));
+    state.counters["table_bytes"] = (16ULL << bits) * sizeof(uint64_t);
+}
+BENCHMARK(fash_set_contains_bmk)ARGS
+
+static void fash_map_contains_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < 2 * n; i++)  {
+            auto found = table.contains_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    state.counters["table_bytes"] = (16ULL << bits) * (sizeof(uint64_t) * 2);
+}
+BENCHMARK(fash_map_contains_bmk)ARGS
+
+// 32-bit keys, one line per bucket. hits use the fash_at_intr_bmk keys;
+// misses use keys from a range that was never inserted.
+static void fash32_at_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash32<uint64_t> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_int32(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.at_int32(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.at_int32(41 + (1<<20)) == 41);
+}
+BENCHMARK(fash32_at_bmk)ARGS
+
+static void fash32_miss_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash32<uint64_t> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_int32(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int32(i+ (1<<30));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.find_int32(41 + (1<<30)) == nullptr);
+    [[maybe_unused]] const bool erased = table.erase_int32(41 + (1<<20));
+    assert(erased);
+    assert(table.find_int32(41 + (1<<20)) == nullptr);
+}
+BENCHMARK(fash32_miss_bmk)ARGS
+
+static void fash_miss_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash<uint64_t, uint64_t> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i+ (1<<30));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.find_int64(41 + (1<<30)) == nullptr);
+}
+BENCHMARK(fash_miss_bmk)ARGS
+
 struct i64hasher {
     size_t operator()( const uint64_t & xx ) const // <-- don't forget const
 	{
@@ -220,4 +580,1564 @@ static void unmap_bmk(benchmark::State &state) {
 }
 BENCHMARK(unmap_bmk)ARGS
 
+// shared table benchmarks. thread 0 builds the table before the timed loop
+// (google benchmark holds every thread at a barrier until it gets there) and
+// tears it down after. each thread draws keys from its own xorshift stream.
+static inline uint64_t xorshift(uint64_t & x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+template <class T>
+struct locked_map {
+    std::mutex lock;
+    T map;
+};
+
+static cfash<uint64_t, uint64_t>* cfash_shared;
+static locked_map<std::unordered_map<uint64_t, uint64_t, i64hasher>>* unmap_shared;
+
+static void cfash_read_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    if(state.thread_index() == 0) {
+        cfash_shared = new cfash<uint64_t, uint64_t>(bits);
+        for(int i = 0; i < n; ++i)
+            cfash_shared->insert_int64(i + (1<<20), i);
+    }
+    uint64_t x = state.thread_index() * 7919 + 1;
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < LOOKUPCOUNT; i++) {
+            auto found = cfash_shared->find_int64(xorshift(x) % n + (1<<20));
+            benchmark::DoNotOptimize(found);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(state.thread_index() == 0) {
+        assert(*cfash_shared->find_int64(41 + (1<<20)) == 41);
+        delete cfash_shared;
+    }
+}
+BENCHMARK(cfash_read_bmk)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+
+// 1 in 8 operations inserts a fresh key from the thread's own key range.
+// the table is sized for 4x the preloaded keys so inserts keep landing.
+static void cfash_mixed_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    if(state.thread_index() == 0) {
+        cfash_shared = new cfash<uint64_t, uint64_t>(bits + 2);
+        for(int i = 0; i < n; ++i)
+            cfash_shared->insert_int64(i + (1<<20), i);
+    }
+    uint64_t x = state.thread_index() * 7919 + 1;
+    uint64_t fresh = (uint64_t(state.thread_index()) + 1) << 40;
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < LOOKUPCOUNT; i++) {
+            auto r = xorshift(x);
+            if((r & 7) == 0) {
+                auto inserted = cfash_shared->insert_int64(fresh++, r);
+                benchmark::DoNotOptimize(inserted);
+            } else {
+                auto found = cfash_shared->find_int64(r % n + (1<<20));
+                benchmark::DoNotOptimize(found);
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(state.thread_index() == 0) {
+        assert(*cfash_shared->find_int64(41 + (1<<20)) == 41);
+        assert(cfash_shared->find_int64(1ULL << 40) != nullptr);
+        delete cfash_shared;
+    }
+}
+BENCHMARK(cfash_mixed_bmk)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+
+static void unmap_locked_read_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    if(state.thread_index() == 0) {
+        unmap_shared = new locked_map<std::unordered_map<uint64_t, uint64_t, i64hasher>>();
+        for(int i = 0; i < n; ++i)
+            unmap_shared->map.insert({i + (1<<20), i});
+    }
+    uint64_t x = state.thread_index() * 7919 + 1;
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < LOOKUPCOUNT; i++) {
+            std::lock_guard<std::mutex> guard(unmap_shared->lock);
+            auto& found = unmap_shared->map.at(xorshift(x) % n + (1<<20));
+            benchmark::DoNotOptimize(found);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(state.thread_index() == 0)
+        delete unmap_shared;
+}
+BENCHMARK(unmap_locked_read_bmk)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+
+static void unmap_locked_mixed_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    if(state.thread_index() == 0) {
+        unmap_shared = new locked_map<std::unordered_map<uint64_t, uint64_t, i64hasher>>();
+        for(int i = 0; i < n; ++i)
+            unmap_shared->map.insert({i + (1<<20), i});
+    }
+    uint64_t x = state.thread_index() * 7919 + 1;
+    uint64_t fresh = (uint64_t(state.thread_index()) + 1) << 40;
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < LOOKUPCOUNT; i++) {
+            auto r = xorshift(x);
+            std::lock_guard<std::mutex> guard(unmap_shared->lock);
+            if((r & 7) == 0) {
+                auto inserted = unmap_shared->map.insert({fresh++, r});
+                benchmark::DoNotOptimize(inserted);
+            } else {
+                auto& found = unmap_shared->map.at(r % n + (1<<20));
+                benchmark::DoNotOptimize(found);
+            }
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(state.thread_index() == 0)
+        delete unmap_shared;
+}
+BENCHMARK(unmap_locked_mixed_bmk)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+
+// hit and miss lookups through find_int64 for the 128 slot tables. misses use
+// keys from a range that was never inserted.
+template <class T>
+static void fash128_find_hit_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.try_insert_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(*table.find_int64(41 + (1<<20)) == 41);
+}
+BENCHMARK_TEMPLATE(fash128_find_hit_bmk, fash128x<uint64_t, uint64_t>)ARGS
+BENCHMARK_TEMPLATE(fash128_find_hit_bmk, fash128x2<uint64_t, uint64_t>)ARGS
+BENCHMARK_TEMPLATE(fash128_find_hit_bmk, fash128xt<uint64_t, uint64_t>)ARGS
+
+template <class T>
+static void fash128_find_miss_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.try_insert_int64(i+ (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i+ (1ULL<<40));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.find_int64(41 + (1ULL<<40)) == nullptr);
+}
+BENCHMARK_TEMPLATE(fash128_find_miss_bmk, fash128x<uint64_t, uint64_t>)ARGS
+BENCHMARK_TEMPLATE(fash128_find_miss_bmk, fash128x2<uint64_t, uint64_t>)ARGS
+BENCHMARK_TEMPLATE(fash128_find_miss_bmk, fash128xt<uint64_t, uint64_t>)ARGS
+
+// same keys as fash128_at_no_intr_bmk / fash128x2_bmk, resolved through the
+// prefetch pipeline. the second argument is the prefetch distance in keys.
+template <class T>
+static void fash128_at_batch_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+    std::vector<uint64_t> keys(n);
+    std::vector<uint64_t> found(n);
+
+    for(int i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        table.insert_no_intrinsic_int64(keys[i], i);
+    }
+
+    for (auto _ : state)
+    {
+        auto misses = table.at_batch(keys.data(), n, found.data(), nullptr, state.range(1));
+        benchmark::DoNotOptimize(misses);
+        benchmark::ClobberMemory();
+    }
+
+    assert(found[41] == 41);
+    keys[1] = 1;
+    assert(table.at_batch(keys.data(), 3, found.data()) == 1);
+}
+BENCHMARK_TEMPLATE(fash128_at_batch_bmk, fash128x<uint64_t, uint64_t>)BATCH_ARGS
+BENCHMARK_TEMPLATE(fash128_at_batch_bmk, fash128x2<uint64_t, uint64_t>)BATCH_ARGS
+BENCHMARK_TEMPLATE(fash128_at_batch_bmk, fash128x<uint64_t, uint64_t>)BATCH_DISTANCE_ARGS
+BENCHMARK_TEMPLATE(fash128_at_batch_bmk, fash128x2<uint64_t, uint64_t>)BATCH_DISTANCE_ARGS
+
+// inserts 2^bits keys into a growable table that starts at bit size 10 and
+// reports the per-insert latency distribution. the third template argument is
+// the migration step: 0 rehashes everything at once when the threshold is hit.
+template <class T, unsigned int STEP>
+static void fash_grow_insert_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    std::vector<uint64_t> latency(n);
+
+    for (auto _ : state)
+    {
+        fash_growable<T> table(10, 1.0, STEP);
+        for(int i = 0; i < n; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            table.insert_int64(i + (1<<20), i);
+            latency[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        state.PauseTiming();
+        for(int i = 0; i < n; i += 97)
+            assert(*table.find_int64(i + (1<<20)) == uint64_t(i));
+        state.ResumeTiming();
+    }
+
+    std::sort(latency.begin(), latency.end());
+    state.counters["p50_ns"] = latency[n / 2];
+    state.counters["p99_ns"] = latency[n - n / 100 - 1];
+    state.counters["p999_ns"] = latency[n - n / 1000 - 1];
+    state.counters["max_ns"] = latency[n - 1];
+}
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash<uint64_t, uint64_t>, 1)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash<uint64_t, uint64_t>, 0)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash2<uint64_t, uint64_t>, 1)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash2<uint64_t, uint64_t>, 0)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash128x<uint64_t, uint64_t>, 1)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash128x<uint64_t, uint64_t>, 0)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash128x2<uint64_t, uint64_t>, 1)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash128x2<uint64_t, uint64_t>, 0)GROW_ARGS
+BENCHMARK_TEMPLATE(fash_grow_insert_bmk, fash_table<uint64_t, uint64_t, fash_soa, 128, fash_probe_guess>, 1)GROW_ARGS
+
+// growing out of a table that has overflowed into its stash: 2^bits keys go
+// into a fash with exactly 2^bits slots, so the fuller buckets spill into the
+// stash, then a fash_growable takes it over and inserts 2^bits more. the old
+// table's stashed keys are migrated with their buckets, and every key is
+// checked afterwards.
+static void fash_grow_stash_bmk(benchmark::State &state) {
+    const int bits  = state.range(0);
+    const uint64_t n = 1ULL << bits;
+    uint64_t stashed = 0;
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto* full = new fash<uint64_t, uint64_t>(bits - 4);
+        for(uint64_t i = 0; i < n; ++i)
+            full->insert_no_intrinsic_int64(i + (1<<20), i);
+        stashed = full->stash_size();
+        state.ResumeTiming();
+
+        fash_growable<fash<uint64_t, uint64_t>> table(full, n);
+        for(uint64_t i = n; i < 2 * n; ++i)
+            table.insert_int64(i + (1<<20), i);
+
+        state.PauseTiming();
+        assert(table.size() == 2 * n);
+        for(uint64_t i = 0; i < 2 * n; ++i) {
+            auto found = table.find_int64(i + (1<<20));
+            assert(found && *found == i);
+            benchmark::DoNotOptimize(found);
+        }
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["stashed"] = stashed;
+}
+BENCHMARK(fash_grow_stash_bmk)->Arg(12)->Arg(16);
+
+// hash policies against key sets that trip up weak hashes: sequential, a
+// 4096 stride (only high bits vary), and random. tables are filled to half
+// their slots so the overflow counter tells the policies apart; the timed
+// loop is find_int64 over every key inserted.
+enum fash_keyset { keys_sequential, keys_strided, keys_random };
+
+static std::vector<uint64_t> policy_keys(int count, int keyset) {
+    std::vector<uint64_t> keys(count);
+    uint64_t x = 88172645463325252ULL;
+    for(int i = 0; i < count; ++i) {
+        if(keyset == keys_sequential)
+            keys[i] = i + 1;
+        else if(keyset == keys_strided)
+            keys[i] = uint64_t(i + 1) << 12;
+        else
+            keys[i] = xorshift(x) | 1;
+    }
+    return keys;
+}
+
+template <class H>
+static void fash_hash_policy_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 8 << bits;
+    auto keys = policy_keys(n, state.range(1));
+    fash<uint64_t, uint64_t, H> table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(keys[i], i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(keys[i]);
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(*table.find_int64(keys[41]) == 41);
+    state.counters["overflow_pct"] = 100.0 * table.overflow_count() / n;
+    state.counters["ns_per_op"] = benchmark::Counter(n, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+#define POLICY_ARGS ->ArgsProduct({{12, 16, 20}, {keys_sequential, keys_strided, keys_random}});
+BENCHMARK_TEMPLATE(fash_hash_policy_bmk, fash_mix_hash)POLICY_ARGS
+BENCHMARK_TEMPLATE(fash_hash_policy_bmk, fash_crc_hash)POLICY_ARGS
+BENCHMARK_TEMPLATE(fash_hash_policy_bmk, fash_aes_hash)POLICY_ARGS
+BENCHMARK_TEMPLATE(fash_hash_policy_bmk, fash_mulshift_hash)POLICY_ARGS
+
+// fash_table across layout x bucket width x probe. every combination has
+// 2^(bits+1) slots and is filled to its nominal 2^bits keys (50%), so rows
+// with the same bits compare equal memory. find runs over hits (arg 0) or
+// misses (arg 1).
+#define TABLE_ARGS ->ArgsProduct({{12, 16, 20, 24}, {0, 1}});
+#define TABLE_INSERT_ARGS ->Args({12})->Args({16})->Args({20})->Args({24});
+#define FASH_TABLE_MATRIX(bmk, args) \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 16, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 16, fash_probe_guess>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 32, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 32, fash_probe_guess>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 128, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_soa, 128, fash_probe_guess>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 16, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 16, fash_probe_guess>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 32, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 32, fash_probe_guess>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 128, fash_probe_scan>)args \
+    BENCHMARK_TEMPLATE(bmk, fash_table<uint64_t, uint64_t, fash_aos, 128, fash_probe_guess>)args
+
+template <class T>
+static void fash_table_find_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    uint64_t offset = state.range(1) ? (1ULL << 40) : (1 << 20);
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_int64(i + (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i + offset);
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.at_int64(41 + (1<<20)) == 41);
+    assert(table.find_int64(41 + (1ULL<<40)) == nullptr);
+    state.counters["stash"] = table.stash_size();
+}
+FASH_TABLE_MATRIX(fash_table_find_bmk, TABLE_ARGS)
+
+// insert n keys, then erase them untimed so every iteration starts from the
+// same empty (already faulted in) table.
+template <class T>
+static void fash_table_insert_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)
+            table.insert_int64(i + (1<<20), i);
+
+        state.PauseTiming();
+        for(int i = 0; i < n; i += 3)
+            assert(*table.find_int64(i + (1<<20)) == uint64_t(i));
+        for(int i = 0; i < n; i++)
+            table.erase_int64(i + (1<<20));
+        assert(table.stash_size() == 0 && table.find_int64(1<<20) == nullptr);
+        state.ResumeTiming();
+    }
+}
+FASH_TABLE_MATRIX(fash_table_insert_bmk, TABLE_INSERT_ARGS)
+
+template <class T>
+static void fash_table_at_batch_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+    std::vector<uint64_t> keys(n), values(n), out(n);
+
+    for(int i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        values[i] = i;
+    }
+    [[maybe_unused]] const size_t duplicates = table.insert_batch(keys.data(), values.data(), n);
+    assert(duplicates == 0);
+
+    for(int i = 0; i < n; ++i) {
+        keys[i] = (uint64_t(i) * 0x9e3779b97f4a7c15ULL) % n + (1<<20);
+    }
+
+    for (auto _ : state)
+    {
+        auto misses = table.at_batch(keys.data(), n, out.data());
+        benchmark::DoNotOptimize(misses);
+        benchmark::ClobberMemory();
+    }
+
+    [[maybe_unused]] const size_t misses = table.at_batch(keys.data(), n, out.data());
+    assert(misses == 0);
+    for(int j = 0; j < n; ++j)
+        assert(out[j] == keys[j] - (1<<20));
+}
+FASH_TABLE_MATRIX(fash_table_at_batch_bmk, TABLE_INSERT_ARGS)
+
+// miss-heavy lookups: n finds of which arg 1 percent are for absent keys, on a
+// table at nominal fill, with and without a bloom filter in front.
+static std::vector<uint64_t> miss_stream(int n, int miss_pct) {
+    std::vector<uint64_t> keys(n);
+    uint64_t x = 88172645463325252ULL;
+    for(int i = 0; i < n; ++i) {
+        const auto r = xorshift(x);
+        keys[i] = (r % 100 < uint64_t(miss_pct)) ? (r >> 8) % n + (1ULL << 40) : (r >> 8) % n + (1<<20);
+    }
+    return keys;
+}
+
+template <class T>
+static void fash_miss_rate_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.try_insert_int64(i + (1<<20), i);
+    }
+
+    const auto keys = miss_stream(n, state.range(1));
+    uint64_t hits = 0;
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(keys[i]);
+            hits += found != nullptr;
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(*table.find_int64(41 + (1<<20)) == 41);
+    assert(table.find_int64(41 + (1ULL<<40)) == nullptr);
+    state.counters["hit_pct"] = 100.0 * hits / (double(n) * state.iterations());
+}
+#define MISS_ARGS ->ArgsProduct({{16, 20, 24}, {10, 50, 90}});
+BENCHMARK_TEMPLATE(fash_miss_rate_bmk, fash128x<uint64_t, uint64_t>)MISS_ARGS
+BENCHMARK_TEMPLATE(fash_miss_rate_bmk, fash_filtered<fash128x<uint64_t, uint64_t>>)MISS_ARGS
+BENCHMARK_TEMPLATE(fash_miss_rate_bmk, fash<uint64_t, uint64_t>)MISS_ARGS
+BENCHMARK_TEMPLATE(fash_miss_rate_bmk, fash_filtered<fash<uint64_t, uint64_t>>)MISS_ARGS
+
+// two-choice placement at high load. the table is filled to arg 1 percent of
+// its slots, then every key is looked up; bytes_per_key is table plus stash
+// memory over keys stored. fash_load_bmk gives the same two numbers for fash
+// and fash128x at their usual fill.
+static void fash_cuckoo_find_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    fash_cuckoo<uint64_t, uint64_t> table(bits);
+    const int n = table.slot_count() * state.range(1) / 100;
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_int64(i + (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i + (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.size() == uint64_t(n) && table.at_int64(41 + (1<<20)) == 41);
+    for(int i = 0; i < n; i += 2) {
+        [[maybe_unused]] const bool erased = table.erase_int64(i + (1<<20));
+        assert(erased);
+    }
+    for(int i = 1; i < n; i += 2)
+        assert(*table.find_int64(i + (1<<20)) == uint64_t(i));
+
+    state.counters["load"] = double(n) / table.slot_count();
+    state.counters["bytes_per_key"] = double(table.bytes()) / n;
+    state.counters["stash"] = table.stash_size();
+    state.counters["ns_per_op"] = benchmark::Counter(n, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(fash_cuckoo_find_bmk)->ArgsProduct({{16, 20, 24}, {50, 85, 90, 95}});
+
+template <class T>
+static void fash_load_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.try_insert_int64(i + (1<<20), i);
+    }
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i + (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    // both tables keep a key and a value array of (16 << bits) and (2 << bits) slots.
+    const double slots = std::is_same_v<T, fash<uint64_t, uint64_t>> ? (16.0 * n) : (2.0 * n);
+    state.counters["load"] = n / slots;
+    state.counters["bytes_per_key"] = slots * 16 / n;
+    state.counters["ns_per_op"] = benchmark::Counter(n, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK_TEMPLATE(fash_load_bmk, fash<uint64_t, uint64_t>)->Args({16})->Args({20})->Args({24});
+BENCHMARK_TEMPLATE(fash_load_bmk, fash128x<uint64_t, uint64_t>)->Args({16})->Args({20})->Args({24});
+
+// walking every live entry of a sparse fash128x (arg 1 percent of its nominal
+// capacity) at bit_size 24: export_to's compressstore scan, the same split over
+// 4 threads by bucket range, and the one-slot-at-a-time iterator.
+#define EXPORT_ARGS ->ArgsProduct({{24}, {1, 10, 50}})->Unit(benchmark::kMillisecond);
+
+static void fill_sparse(fash128x<uint64_t, uint64_t> & table, int n, int pct) {
+    for(int i = 0; i < n; ++i) {
+        if(uint64_t(i) * 0x9e3779b97f4a7c15ULL % 100 < uint64_t(pct))
+            table.try_insert_int64(i + (1<<20), i);
+    }
+}
+
+static void fash128_export_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash128x<uint64_t, uint64_t> table(bits);
+    fill_sparse(table, n, state.range(1));
+    std::vector<uint64_t> keys(n), values(n);
+    uint64_t count = 0;
+
+    for (auto _ : state)
+    {
+        count = table.export_to(keys.data(), values.data());
+        benchmark::DoNotOptimize(count);
+        benchmark::ClobberMemory();
+    }
+
+    assert(count == table.count_live() && values[7] == keys[7] - (1<<20));
+    state.counters["entries"] = count;
+}
+BENCHMARK(fash128_export_bmk)EXPORT_ARGS
+
+static void fash128_export_parallel_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    const int parts = 4;
+    fash128x<uint64_t, uint64_t> table(bits);
+    fill_sparse(table, n, state.range(1));
+    std::vector<uint64_t> keys(n), values(n);
+    uint64_t count = 0;
+
+    for (auto _ : state)
+    {
+        // count each range, then export each range at its prefix offset.
+        uint64_t offset[parts + 1] = {0};
+        const uint64_t step = table.bucket_count() / parts;
+        std::vector<std::thread> workers;
+        for(int p = 0; p < parts; ++p)
+            workers.emplace_back([&, p] { offset[p + 1] = table.count_live(p * step, (p + 1) * step); });
+        for(auto & w : workers)
+            w.join();
+        for(int p = 0; p < parts; ++p)
+            offset[p + 1] += offset[p];
+
+        workers.clear();
+        for(int p = 0; p < parts; ++p)
+            workers.emplace_back([&, p] { table.export_to(keys.data() + offset[p], values.data() + offset[p], p * step, (p + 1) * step); });
+        for(auto & w : workers)
+            w.join();
+
+        count = offset[parts];
+        benchmark::DoNotOptimize(count);
+        benchmark::ClobberMemory();
+    }
+
+    assert(count == table.count_live() && values[7] == keys[7] - (1<<20));
+    state.counters["entries"] = count;
+}
+BENCHMARK(fash128_export_parallel_bmk)->ArgsProduct({{24}, {1, 10, 50}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void fash128_iterate_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    fash128x<uint64_t, uint64_t> table(bits);
+    fill_sparse(table, n, state.range(1));
+    std::vector<uint64_t> keys(n), values(n);
+    uint64_t count = 0;
+
+    for (auto _ : state)
+    {
+        count = 0;
+        for(auto e : table) {
+            keys[count] = e.key;
+            values[count++] = e.value;
+        }
+        benchmark::DoNotOptimize(count);
+        benchmark::ClobberMemory();
+    }
+
+    assert(count == table.count_live() && values[7] == keys[7] - (1<<20));
+    state.counters["entries"] = count;
+}
+BENCHMARK(fash128_iterate_bmk)EXPORT_ARGS
+
+// bounded caches under uniform (arg 1 = 0) and zipf 0.99 (arg 1 = 1) streams
+// over a key universe 4x the capacity. the compute step is trivial, so ns_per_op
+// is the cache's own cost. the baseline is the usual unordered_map + list LRU
+// with the same capacity.
+class lru_map {
+    std::list<std::pair<uint64_t, uint64_t>> m_order;
+    std::unordered_map<uint64_t, std::list<std::pair<uint64_t, uint64_t>>::iterator, i64hasher> m_index;
+    size_t m_capacity;
+
+public:
+    uint64_t hits = 0, misses = 0;
+
+    lru_map(size_t capacity) : m_capacity(capacity) {
+        m_index.reserve(capacity);
+    }
+
+    template <class F>
+    uint64_t & get_or_compute(const uint64_t & key, F && compute) {
+        auto it = m_index.find(key);
+        if(it != m_index.end()) {
+            ++hits;
+            m_order.splice(m_order.begin(), m_order, it->second);
+            return it->second->second;
+        }
+
+        ++misses;
+        if(m_index.size() == m_capacity) {
+            m_index.erase(m_order.back().first);
+            m_order.pop_back();
+        }
+        m_order.emplace_front(key, compute(key));
+        m_index.emplace(key, m_order.begin());
+        return m_order.front().second;
+    }
+};
+
+static std::vector<uint64_t> cache_stream(size_t n, uint64_t universe, bool zipf) {
+    std::vector<uint64_t> keys(n);
+    uint64_t x = 88172645463325252ULL;
+
+    if(!zipf) {
+        for(auto & k : keys)
+            k = xorshift(x) % universe + 1;
+        return keys;
+    }
+
+    // inverse cdf over rank; ranks are scattered over the universe so hot keys
+    // don't share buckets by construction.
+    std::vector<double> cdf(universe);
+    double sum = 0;
+    for(uint64_t r = 0; r < universe; ++r)
+        cdf[r] = sum += 1.0 / std::pow(double(r + 1), 0.99);
+    for(auto & k : keys) {
+        const double u = (xorshift(x) >> 11) * (1.0 / 9007199254740992.0) * sum;
+        const uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        k = (rank * 0x9e3779b97f4a7c15ULL) % universe + 1;
+    }
+    return keys;
+}
+
+#define CACHE_ARGS ->ArgsProduct({{10, 14, 18}, {0, 1}});
+
+static void fash_cache_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    fash_cache<uint64_t, uint64_t> cache(bits);
+    const auto keys = cache_stream(1 << 22, 4 * cache.capacity(), state.range(1));
+
+    for (auto _ : state)
+    {
+        for(auto k : keys) {
+            auto & v = cache.get_or_compute(k, [](const uint64_t & key) { return key * 3; });
+            benchmark::DoNotOptimize(v);
+        }
+    }
+
+    assert(cache.get_or_compute(keys.back(), [](const uint64_t &) { return uint64_t(0); }) == keys.back() * 3);
+    state.counters["hit_pct"] = 100.0 * cache.hit_count() / (cache.hit_count() + cache.miss_count());
+    state.counters["ns_per_op"] = benchmark::Counter(keys.size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(fash_cache_bmk)CACHE_ARGS
+
+static void lru_map_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    const size_t capacity = size_t(16) << bits;
+    lru_map cache(capacity);
+    const auto keys = cache_stream(1 << 22, 4 * capacity, state.range(1));
+
+    for (auto _ : state)
+    {
+        for(auto k : keys) {
+            auto & v = cache.get_or_compute(k, [](const uint64_t & key) { return key * 3; });
+            benchmark::DoNotOptimize(v);
+        }
+    }
+
+    assert(cache.get_or_compute(keys.back(), [](const uint64_t &) { return uint64_t(0); }) == keys.back() * 3);
+    state.counters["hit_pct"] = 100.0 * cache.hits / (cache.hits + cache.misses);
+    state.counters["ns_per_op"] = benchmark::Counter(keys.size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(lru_map_bmk)CACHE_ARGS
+
+// warm start: rebuilding with insert_no_intrinsic_int64 (arg 1 = 0) against
+// opening a snapshot lazily (1) or with MAP_POPULATE (2). first_lookup_us is
+// the time until the first find is answered and full_speed_ms the time until
+// every key has been found once, i.e. every page has been touched. the file is
+// written once up front, so it is in the page cache: a restart on the same box.
+static void fash_snapshot_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    const auto mode = state.range(1);
+    const std::string path = "/tmp/fash_snapshot_bmk_" + std::to_string(bits) + ".bin";
+
+    if(mode) {
+        fash<uint64_t, uint64_t> table(bits);
+        for(int i = 0; i < n; ++i)
+            table.insert_no_intrinsic_int64(i + (1<<20), i);
+        table.save(path.c_str());
+        fash<uint64_t, uint64_t> check(path.c_str(), fash_open_verify);
+        assert(*check.find_int64(41 + (1<<20)) == 41 && check.stash_size() == table.stash_size());
+    }
+
+    double first = 0, full = 0;
+    for (auto _ : state)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<fash<uint64_t, uint64_t>> table;
+        if(mode == 0) {
+            table = std::make_unique<fash<uint64_t, uint64_t>>(bits);
+            for(int i = 0; i < n; ++i)
+                table->insert_no_intrinsic_int64(i + (1<<20), i);
+        } else {
+            table = std::make_unique<fash<uint64_t, uint64_t>>(path.c_str(), mode == 2 ? fash_open_populate : fash_open_lazy);
+        }
+
+        auto found = table->find_int64(n / 2 + (1<<20));
+        benchmark::DoNotOptimize(found);
+        const auto answered = std::chrono::steady_clock::now();
+
+        uint64_t sum = 0;
+        for(int i = 0; i < n; ++i)
+            sum += *table->find_int64(i + (1<<20));
+        benchmark::DoNotOptimize(sum);
+        const auto done = std::chrono::steady_clock::now();
+
+        assert(sum == uint64_t(n) * (n - 1) / 2);
+        first = std::chrono::duration<double, std::micro>(answered - start).count();
+        full = std::chrono::duration<double, std::milli>(done - start).count();
+        state.SetIterationTime(std::chrono::duration<double>(done - start).count());
+    }
+
+    if(mode)
+        unlink(path.c_str());
+    state.counters["first_lookup_us"] = first;
+    state.counters["full_speed_ms"] = full;
+}
+BENCHMARK(fash_snapshot_bmk)->ArgsProduct({{18, 20, 22}, {0, 1, 2}})->UseManualTime()->Unit(benchmark::kMillisecond)->Iterations(3);
+
+// page policy: the same lookup loop over fash and fash128x backed by 4 KB
+// pages, transparent huge pages and MAP_HUGETLB (which falls back to THP when
+// vm.nr_hugepages can't cover the table). dtlb_miss_per_op comes from
+// perf_event_open and is left out where the kernel or VM won't count it;
+// huge_mb is the process's AnonHugePages after the table is filled, to show
+// whether the kernel actually handed out huge pages.
+struct dtlb_counter {
+    int fd = -1;
+
+    dtlb_counter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~dtlb_counter() {
+        if(fd >= 0)
+            close(fd);
+    }
+
+    void start() {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if(read(fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+};
+
+static double anon_huge_mb() {
+    std::ifstream in("/proc/self/smaps_rollup");
+    std::string line;
+    while(std::getline(in, line))
+        if(line.rfind("AnonHugePages:", 0) == 0)
+            return std::stod(line.substr(14)) / 1024;
+    return 0;
+}
+
+template <class T>
+static void fash_pages_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.insert_no_intrinsic_int64(i+ (1<<20), i);
+    }
+    state.counters["huge_mb"] = anon_huge_mb();
+
+    dtlb_counter dtlb;
+    if(dtlb.fd >= 0)
+        dtlb.start();
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i+ (1<<20));
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+    if(dtlb.fd >= 0) {
+        const uint64_t misses = dtlb.stop();
+        if(misses)
+            state.counters["dtlb_miss_per_op"] = double(misses) / (double(state.iterations()) * n);
+    }
+
+    state.counters["ns_per_op"] = benchmark::Counter(n, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    assert(*table.find_int64(41 + (1<<20)) == 41);
+}
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash<uint64_t, uint64_t, fash_mix_hash, fash_small_pages>)ARGS
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash<uint64_t, uint64_t, fash_mix_hash, fash_thp_pages>)ARGS
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash<uint64_t, uint64_t, fash_mix_hash, fash_huge_pages>)ARGS
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash128x<uint64_t, uint64_t, fash_mix_hash, fash_small_pages>)ARGS
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash128x<uint64_t, uint64_t, fash_mix_hash, fash_thp_pages>)ARGS
+BENCHMARK_TEMPLATE(fash_pages_bmk, fash128x<uint64_t, uint64_t, fash_mix_hash, fash_huge_pages>)ARGS
+
+// sharding: 2^bits keys in one fash128x, in 8 fash128x shards built and loaded
+// from the calling thread (node oblivious), and in 8 shards built and loaded by
+// one owner per shard (fewer with fewer cpus), dealt round-robin over the NUMA
+// nodes, so first touch puts half the shards on each node of a 2 socket box.
+// read rows are random lookups from benchmark threads; batch rows push 2^14
+// random keys through at_batch (unsharded) or at_batch_owned.
+using shard_table = fash128x<uint64_t, uint64_t, fash_mix_hash, fash_touched_pages<>>;
+using sharded_table = fash_sharded<shard_table>;
+
+static shard_table* shard_whole;
+static sharded_table* shard_split;
+
+template <int Mode>
+static void shard_build(int bits) {
+    const uint64_t n = 1ULL << bits;
+    if(Mode == 0) {
+        shard_whole = new shard_table(bits);
+        for(uint64_t i = 0; i < n; ++i)
+            shard_whole->insert_no_intrinsic_int64(i + (1<<20), i);
+        return;
+    }
+
+    shard_split = new sharded_table(3, bits - 3, Mode == 2 ? std::clamp(std::thread::hardware_concurrency(), 1u, 8u) : 0);
+    std::vector<uint64_t> keys(n), values(n);
+    for(uint64_t i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        values[i] = i;
+    }
+    shard_split->insert_owned(keys.data(), values.data(), n);
+}
+
+template <int Mode>
+static void shard_drop() {
+    if(Mode == 0) {
+        assert(*shard_whole->find_int64(41 + (1<<20)) == 41);
+        delete shard_whole;
+    } else {
+        assert(*shard_split->find_int64(41 + (1<<20)) == 41);
+        delete shard_split;
+    }
+}
+
+template <int Mode>
+static void fash_shard_read_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    if(state.thread_index() == 0)
+        shard_build<Mode>(bits);
+    uint64_t x = state.thread_index() * 7919 + 1;
+
+    for (auto _ : state)
+    {
+        for(int i = 0; i < LOOKUPCOUNT; i++) {
+            const uint64_t key = xorshift(x) % n + (1<<20);
+            auto found = Mode == 0 ? shard_whole->find_int64(key) : shard_split->find_int64(key);
+            benchmark::DoNotOptimize(found);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(state.thread_index() == 0)
+        shard_drop<Mode>();
+}
+BENCHMARK_TEMPLATE(fash_shard_read_bmk, 0)->Arg(22)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_shard_read_bmk, 1)->Arg(22)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_shard_read_bmk, 2)->Arg(22)->ThreadRange(1, 32)->UseRealTime();
+
+template <int Mode>
+static void fash_shard_batch_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    const size_t batch = 1 << 14;
+    shard_build<Mode>(bits);
+
+    uint64_t x = 1;
+    std::vector<uint64_t> keys(batch), out(batch);
+    for(auto & k : keys)
+        k = xorshift(x) % n + (1<<20);
+
+    for (auto _ : state)
+    {
+        auto misses = Mode == 0 ? shard_whole->at_batch(keys.data(), batch, out.data()) : shard_split->at_batch_owned(keys.data(), batch, out.data());
+        benchmark::DoNotOptimize(misses);
+        benchmark::ClobberMemory();
+    }
+
+    assert(out[7] == keys[7] - (1<<20));
+    state.counters["ns_per_op"] = benchmark::Counter(batch, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    shard_drop<Mode>();
+}
+BENCHMARK_TEMPLATE(fash_shard_batch_bmk, 0)->Arg(20)->Arg(22)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_shard_batch_bmk, 1)->Arg(20)->Arg(22)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_shard_batch_bmk, 2)->Arg(20)->Arg(22)->UseRealTime();
+
+// hash join: a build side of 2^bits reference rows (range(1) rows per key, so
+// 1 is a unique-key join) probed by 2^20 trade rows drawn from twice the build
+// key range, i.e. about half of them match. range(2) = 1 runs fash_join in
+// radix mode with radix_bits() partitions. items are probe rows.
+static void join_columns(int bits, int dup, std::vector<uint64_t> & build, std::vector<uint64_t> & payload, std::vector<uint64_t> & probe) {
+    const uint64_t n = 1ULL << bits;
+    const uint64_t distinct = n / dup;
+    build.resize(n);
+    payload.resize(n);
+    for(uint64_t i = 0; i < n; ++i) {
+        build[i] = i % distinct + (1<<20);
+        payload[i] = i;
+    }
+
+    uint64_t x = 1;
+    probe.resize(1 << 20);
+    for(auto & k : probe)
+        k = xorshift(x) % (2 * distinct) + (1<<20);
+}
+
+static void fash_join_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    const int dup = state.range(1);
+    std::vector<uint64_t> build, payload, probe;
+    join_columns(bits, dup, build, payload, probe);
+
+    const auto start = std::chrono::steady_clock::now();
+    fash_join<> join(build.data(), payload.data(), build.size(), state.range(2) ? fash_join<>::radix_bits(build.size()) : 0);
+    const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint64_t> out_row(probe.size() * join.max_group()), out_payload(probe.size() * join.max_group());
+    size_t matches = 0;
+    for (auto _ : state)
+    {
+        matches = join.probe(probe.data(), probe.size(), out_row.data(), out_payload.data());
+        benchmark::DoNotOptimize(matches);
+        benchmark::ClobberMemory();
+    }
+
+    assert(join.group_count() == build.size() / dup);
+    std::unordered_multimap<uint64_t, uint64_t, i64hasher> check;
+    for(size_t i = 0; i < build.size(); ++i)
+        check.emplace(build[i], payload[i]);
+    size_t expected = 0;
+    for(auto k : probe) {
+        auto range = check.equal_range(k);
+        expected += std::distance(range.first, range.second);
+    }
+    assert(matches == expected);
+    for(size_t j = 0; j < matches; ++j)
+        assert(out_payload[j] % (build.size() / dup) + (1<<20) == probe[out_row[j]]);
+
+    // the same join through a buffer smaller than a group of 4.
+    fash_join<>::probe_cursor cursor;
+    size_t streamed = 0;
+    while(!cursor.done) {
+        const size_t count = join.probe(probe.data(), probe.size(), out_row.data(), out_payload.data(), 3, cursor);
+        for(size_t j = 0; j < count; ++j)
+            assert(out_payload[j] % (build.size() / dup) + (1<<20) == probe[out_row[j]]);
+        streamed += count;
+    }
+    assert(streamed == expected);
+    state.SetItemsProcessed(state.iterations() * probe.size());
+    state.counters["matches"] = matches;
+    state.counters["partitions"] = 1 << join.partition_bits();
+    state.counters["build_ms"] = build_ms;
+}
+BENCHMARK(fash_join_bmk)->ArgsProduct({{16, 20, 22}, {1, 4}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+static void unmap_join_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    const int dup = state.range(1);
+    std::vector<uint64_t> build, payload, probe;
+    join_columns(bits, dup, build, payload, probe);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::unordered_multimap<uint64_t, uint64_t, i64hasher> join;
+    join.reserve(build.size());
+    for(size_t i = 0; i < build.size(); ++i)
+        join.emplace(build[i], payload[i]);
+    const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<uint64_t> out_row(probe.size() * dup), out_payload(probe.size() * dup);
+    size_t matches = 0;
+    for (auto _ : state)
+    {
+        matches = 0;
+        for(size_t r = 0; r < probe.size(); ++r) {
+            auto range = join.equal_range(probe[r]);
+            for(auto it = range.first; it != range.second; ++it) {
+                out_row[matches] = r;
+                out_payload[matches++] = it->second;
+            }
+        }
+        benchmark::DoNotOptimize(matches);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * probe.size());
+    state.counters["matches"] = matches;
+    state.counters["build_ms"] = build_ms;
+}
+BENCHMARK(unmap_join_bmk)->ArgsProduct({{16, 20, 22}, {1, 4}})->Unit(benchmark::kMillisecond);
+
+// group-by: 2^22 rows of (instrument, qty, px) rolled up to sum/count/min/max
+// of both value columns per instrument, over 2^range(0) instruments. range(1)
+// is the number of partial tables add_parallel splits the rows over (1 is the
+// plain add). items are rows.
+static void groupby_columns(int card, std::vector<uint64_t> & keys, std::vector<int64_t> & qty, std::vector<int64_t> & px) {
+    const size_t n = 1 << 22;
+    keys.resize(n);
+    qty.resize(n);
+    px.resize(n);
+    uint64_t x = 1;
+    for(size_t i = 0; i < n; ++i) {
+        keys[i] = xorshift(x) % (1ULL << card) + (1<<20);
+        qty[i] = int64_t(x >> 40) - (1 << 23);
+        px[i] = int64_t(x & 0xFFFFF);
+    }
+}
+
+static void fash_groupby_bmk(benchmark::State &state) {
+    const int card = state.range(0);
+    const unsigned int threads = state.range(1);
+    std::vector<uint64_t> keys;
+    std::vector<int64_t> qty, px;
+    groupby_columns(card, keys, qty, px);
+    const int64_t* columns[] = {qty.data(), px.data()};
+    const unsigned char bits = std::max(card - 3, 1);
+
+    uint64_t groups = 0;
+    for (auto _ : state)
+    {
+        fash_groupby<int64_t> agg(bits, 2);
+        agg.add_parallel(keys.data(), columns, keys.size(), threads);
+        groups = agg.size();
+        benchmark::DoNotOptimize(agg.sums(0));
+
+        state.PauseTiming();
+        int64_t sum = 0, lo = std::numeric_limits<int64_t>::max();
+        uint64_t count = 0;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            if(keys[i] == keys[0]) {
+                sum += qty[i];
+                lo = std::min(lo, qty[i]);
+                ++count;
+            }
+        }
+        const auto g = agg.group_of(keys[0]);
+        assert(agg.sums(0)[g] == sum && agg.mins(0)[g] == lo && agg.counts()[g] == count);
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["groups"] = groups;
+}
+BENCHMARK(fash_groupby_bmk)->ArgsProduct({{6, 12, 20}, {1, 2}})->Unit(benchmark::kMillisecond);
+
+struct unmap_aggregate {
+    int64_t sum[2] = {0, 0};
+    int64_t min[2] = {std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::max()};
+    int64_t max[2] = {std::numeric_limits<int64_t>::lowest(), std::numeric_limits<int64_t>::lowest()};
+    uint64_t count = 0;
+};
+
+static void unmap_groupby_bmk(benchmark::State &state) {
+    const int card = state.range(0);
+    std::vector<uint64_t> keys;
+    std::vector<int64_t> qty, px;
+    groupby_columns(card, keys, qty, px);
+
+    uint64_t groups = 0;
+    for (auto _ : state)
+    {
+        std::unordered_map<uint64_t, unmap_aggregate, i64hasher> agg;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            auto & a = agg[keys[i]];
+            const int64_t v[2] = {qty[i], px[i]};
+            for(int c = 0; c < 2; ++c) {
+                a.sum[c] += v[c];
+                a.min[c] = std::min(a.min[c], v[c]);
+                a.max[c] = std::max(a.max[c], v[c]);
+            }
+            ++a.count;
+        }
+        groups = agg.size();
+        benchmark::DoNotOptimize(agg);
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["groups"] = groups;
+}
+BENCHMARK(unmap_groupby_bmk)->Arg(6)->Arg(12)->Arg(20)->Unit(benchmark::kMillisecond);
+
+// the read-only table: 2^bits keys in a fash_mph, looked up one at a time
+// (range(1) = 0) or through at_batch in chunks of 4096 (1). the counters line
+// up with fash_load_bmk and fash_cuckoo_find_bmk at the same bits for the
+// fash, fash128x and fash_cuckoo numbers.
+static void fash_mph_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    std::vector<uint64_t> keys(n), values(n), out(n);
+    for(int i = 0; i < n; ++i) {
+        keys[i] = i + (1<<20);
+        values[i] = i;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    fash_mph<uint64_t> table(keys.data(), values.data(), n);
+    const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto _ : state)
+    {
+        if(state.range(1)) {
+            for(int i = 0; i < n; i += 4096) {
+                auto misses = table.at_batch(keys.data() + i, std::min(4096, n - i), out.data() + i);
+                benchmark::DoNotOptimize(misses);
+            }
+            benchmark::ClobberMemory();
+        } else {
+            for(int i = 0; i < n; i++)  {
+                auto found = table.find_int64(i + (1<<20));
+                benchmark::DoNotOptimize(found);
+                benchmark::ClobberMemory();
+            }
+        }
+    }
+
+    assert(table.at_int64(41 + (1<<20)) == 41 && table.find_int64(1ULL << 40) == nullptr);
+    assert(!state.range(1) || out[n - 1] == uint64_t(n - 1));
+    state.counters["load"] = 1;
+    state.counters["bytes_per_key"] = double(table.bytes()) / n;
+    state.counters["build_ms"] = build_ms;
+    state.counters["ns_per_op"] = benchmark::Counter(n, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(fash_mph_bmk)->ArgsProduct({{16, 20, 24}, {0, 1}});
+
+// symbol -> row: 2^bits OCC option symbols (root, expiry, C/P, strike: 21
+// bytes, e.g. "AAPL  240621C00190000") looked up in a scrambled order. the
+// fash_symbols rows go one at a time (range(1) = 0) or through at_batch in
+// chunks of 4096 (1), with and without the verify array; the
+// std::unordered_map<std::string, uint32_t> row looks up std::strings.
+static std::vector<std::string> occ_symbols(int bits) {
+    static const char* roots[] = {"AAPL", "MSFT", "SPY", "QQQ", "TSLA", "NVDA", "AMZN", "IWM", "META", "GOOGL", "AMD", "NFLX"};
+    std::vector<std::string> out;
+    char buf[32];
+    for(uint64_t i = 0; out.size() < (1ULL << bits); ++i) {
+        const char* root = roots[i % 12];
+        const uint64_t rest = i / 12;
+        snprintf(buf, sizeof(buf), "%-6s%02d%02d%02d%c%08llu", root, 24 + int(rest % 3), 1 + int(rest / 3 % 12), 1 + int(rest / 36 % 28),
+                 rest / 1008 % 2 ? 'P' : 'C', (unsigned long long)(rest / 2016 * 500));
+        out.push_back(buf);
+    }
+    return out;
+}
+
+static std::vector<uint32_t> scrambled_rows(int bits) {
+    std::vector<uint32_t> order(1 << bits);
+    uint64_t x = 1;
+    for(uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    for(uint32_t i = order.size() - 1; i > 0; --i)
+        std::swap(order[i], order[xorshift(x) % (i + 1)]);
+    return order;
+}
+
+template <bool Verify>
+static void fash_symbols_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    const auto symbols = occ_symbols(bits);
+    const auto order = scrambled_rows(bits);
+    fash_symbols<uint32_t, Verify> table(std::max<int>(bits - 2, 1));
+    for(uint32_t i = 0; i < symbols.size(); ++i)
+        table.insert(symbols[i], i);
+
+    std::vector<fash_symbol> column;
+    for(auto i : order)
+        column.emplace_back(symbols[i]);
+    std::vector<uint32_t> out(column.size());
+
+    for (auto _ : state)
+    {
+        if(state.range(1)) {
+            for(size_t i = 0; i < column.size(); i += 4096) {
+                auto misses = table.at_batch(column.data() + i, std::min<size_t>(4096, column.size() - i), out.data() + i);
+                benchmark::DoNotOptimize(misses);
+            }
+            benchmark::ClobberMemory();
+        } else {
+            for(const auto & s : column) {
+                auto found = table.find(s);
+                benchmark::DoNotOptimize(found);
+                benchmark::ClobberMemory();
+            }
+        }
+    }
+
+    assert(*table.find(symbols[41]) == 41 && table.find("AAPL  991231C99999999") == nullptr);
+    assert(!state.range(1) || out[7] == order[7]);
+    state.counters["ns_per_op"] = benchmark::Counter(column.size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK_TEMPLATE(fash_symbols_bmk, false)->ArgsProduct({{12, 16, 20}, {0, 1}});
+BENCHMARK_TEMPLATE(fash_symbols_bmk, true)->ArgsProduct({{12, 16, 20}, {0, 1}});
+
+static void unmap_symbols_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    const auto symbols = occ_symbols(bits);
+    const auto order = scrambled_rows(bits);
+    std::unordered_map<std::string, uint32_t> table;
+    for(uint32_t i = 0; i < symbols.size(); ++i)
+        table.emplace(symbols[i], i);
+
+    std::vector<std::string> column;
+    for(auto i : order)
+        column.push_back(symbols[i]);
+
+    for (auto _ : state)
+    {
+        for(const auto & s : column) {
+            auto found = table.find(s);
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    assert(table.at(symbols[41]) == 41);
+    state.counters["ns_per_op"] = benchmark::Counter(column.size(), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(unmap_symbols_bmk)->Arg(12)->Arg(16)->Arg(20);
+
+// count-min: 2^22 messages over 2^20 instruments, zipf 0.99 as in the cache
+// benchmarks. fash_sketch_update_bmk feeds them one add at a time (range(1) =
+// 0), through add_batch (1), or through a fash_heavy_hitters tracking the top
+// 32 (2); unmap_count_bmk keeps exact counts in an std::unordered_map.
+// fash_sketch_error_bmk measures, per sketch width, the mean and worst
+// overcount over every instrument seen (against the e * n / width bound) and
+// how many of the true top 32 the tracker reports.
+static void fash_sketch_update_bmk(benchmark::State &state) {
+    const unsigned char bits = state.range(0);
+    const auto keys = cache_stream(1 << 22, 1 << 20, true);
+
+    for (auto _ : state)
+    {
+        if(state.range(1) == 2) {
+            fash_heavy_hitters<> hot(bits, 32);
+            hot.add_batch(keys.data(), keys.size());
+            benchmark::DoNotOptimize(hot.top());
+            continue;
+        }
+
+        fash_count_min<> sketch(bits);
+        if(state.range(1))
+            sketch.add_batch(keys.data(), keys.size());
+        else
+            for(const auto k : keys)
+                sketch.add(k);
+        assert(sketch.estimate(keys[0]) >= 1 && sketch.total() == keys.size());
+        benchmark::DoNotOptimize(sketch.estimate(keys[0]));
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+    state.counters["bytes"] = double(8ULL << bits) * 4;
+}
+BENCHMARK(fash_sketch_update_bmk)->ArgsProduct({{10, 14, 18}, {0, 1, 2}})->Unit(benchmark::kMillisecond);
+
+static void unmap_count_bmk(benchmark::State &state) {
+    const auto keys = cache_stream(1 << 22, 1 << 20, true);
+
+    for (auto _ : state)
+    {
+        std::unordered_map<uint64_t, uint32_t, i64hasher> counts;
+        for(const auto k : keys)
+            ++counts[k];
+        benchmark::DoNotOptimize(counts);
+    }
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(unmap_count_bmk)->Unit(benchmark::kMillisecond);
+
+static void fash_sketch_error_bmk(benchmark::State &state) {
+    const unsigned char bits = state.range(0);
+    const uint64_t universe = 1 << 20;
+    const auto keys = cache_stream(1 << 22, universe, true);
+    std::vector<uint32_t> exact(universe + 1);
+    for(const auto k : keys)
+        ++exact[k];
+
+    double mean = 0, worst = 0, recall = 0;
+    for (auto _ : state)
+    {
+        fash_heavy_hitters<> hot(bits, 32);
+        hot.add_batch(keys.data(), keys.size());
+
+        uint64_t seen = 0;
+        double sum = 0;
+        worst = 0;
+        for(uint64_t k = 1; k <= universe; ++k) {
+            if(!exact[k])
+                continue;
+            const double over = double(hot.sketch().estimate(k)) - exact[k];
+            assert(over >= 0);
+            sum += over;
+            worst = std::max(worst, over);
+            ++seen;
+        }
+        mean = sum / seen;
+
+        std::vector<uint64_t> ranked(universe);
+        for(uint64_t k = 0; k < universe; ++k)
+            ranked[k] = k + 1;
+        std::partial_sort(ranked.begin(), ranked.begin() + 32, ranked.end(), [&](uint64_t a, uint64_t b) { return exact[a] > exact[b]; });
+        const auto top = hot.top();
+        recall = 0;
+        for(int i = 0; i < 32; ++i)
+            recall += std::any_of(top.begin(), top.end(), [&](const auto & e) { return e.first == ranked[i]; });
+        recall /= 32;
+    }
+
+    state.counters["bytes"] = double(8ULL << bits) * 4;
+    state.counters["mean_over"] = mean;
+    state.counters["max_over"] = worst;
+    state.counters["bound"] = std::exp(1.0) * keys.size() / (1 << bits);
+    state.counters["top32_recall"] = recall;
+}
+BENCHMARK(fash_sketch_error_bmk)->DenseRange(8, 16, 2)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// rcu rebuilds: a 2^bits row reference table (8 keys per bucket) read by
+// every benchmark thread while a writer rebuilds it from scratch and publishes
+// it, back to back. range(1): 0 = fash_rcu with no writer, 1 = fash_rcu with
+// the writer, 2 = stopping the readers: one fash behind a mutex that readers
+// take per batch and the writer holds for the whole rebuild. values carry the
+// version's low byte next to the key, so a reader on a freed or half built
+// table fails the check. thread 0 reports the latency of a batch of
+// LOOKUPCOUNT lookups, pin included, and the count of rebuilds.
+using rcu_table = fash<uint64_t, uint64_t>;
+static fash_rcu<uint64_t, uint64_t>* rcu_shared;
+static locked_map<std::unique_ptr<rcu_table>>* rcu_locked;
+static std::thread rcu_writer;
+static std::atomic<bool> rcu_stop;
+static std::atomic<uint64_t> rcu_rebuilds;
+
+static std::unique_ptr<rcu_table> rcu_build(int bits, uint64_t version) {
+    auto t = std::make_unique<rcu_table>(bits - 3);
+    for(uint64_t i = 0; i < (1ULL << bits); ++i)
+        t->insert_no_intrinsic_int64(i + (1<<20), (i + (1<<20)) << 8 | (version & 0xFF));
+    return t;
+}
+
+static inline uint64_t rcu_read_batch(rcu_table & t, uint64_t & x, uint64_t n) {
+    uint64_t bad = 0;
+    for(int i = 0; i < LOOKUPCOUNT; i++) {
+        const uint64_t key = xorshift(x) % n + (1<<20);
+        auto found = t.find_int64(key);
+        bad += !found || *found >> 8 != key;
+        benchmark::DoNotOptimize(found);
+    }
+    return bad;
+}
+
+template <int Mode>
+static void fash_rcu_bmk(benchmark::State &state) {
+    const int bits  = state.range(0);
+    const uint64_t n = 1ULL << bits;
+    const unsigned int reader = state.thread_index();
+    if(reader == 0) {
+        rcu_stop = false;
+        rcu_rebuilds = 0;
+        if(Mode == 2) {
+            rcu_locked = new locked_map<std::unique_ptr<rcu_table>>();
+            rcu_locked->map = rcu_build(bits, 0);
+        } else {
+            rcu_shared = new fash_rcu<uint64_t, uint64_t>(rcu_build(bits, 0), 32);
+        }
+        if(Mode != 0) {
+            rcu_writer = std::thread([bits] {
+                for(uint64_t v = 1; !rcu_stop.load(std::memory_order_relaxed); ++v) {
+                    if(Mode == 2) {
+                        std::lock_guard<std::mutex> guard(rcu_locked->lock);
+                        rcu_locked->map = rcu_build(bits, v);
+                    } else {
+                        rcu_shared->publish(rcu_build(bits, v));
+                    }
+                    rcu_rebuilds.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+    }
+    uint64_t x = reader * 7919 + 1;
+    uint64_t bad = 0;
+    std::vector<double> latency;
+
+    for (auto _ : state)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if(Mode == 2) {
+            std::lock_guard<std::mutex> guard(rcu_locked->lock);
+            bad += rcu_read_batch(*rcu_locked->map, x, n);
+        } else {
+            auto t = rcu_shared->read(reader);
+            bad += rcu_read_batch(*t, x, n);
+        }
+        if(reader == 0)
+            latency.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    assert(bad == 0);
+    state.SetItemsProcessed(state.iterations() * LOOKUPCOUNT);
+    if(reader == 0) {
+        rcu_stop = true;
+        if(Mode != 0)
+            rcu_writer.join();
+
+        std::sort(latency.begin(), latency.end());
+        const auto pct = [&](double q) { return latency.empty() ? 0.0 : latency[size_t(q * (latency.size() - 1))]; };
+        state.counters["p50_us"] = pct(0.5);
+        state.counters["p99_us"] = pct(0.99);
+        state.counters["max_us"] = pct(1.0);
+        state.counters["rebuilds"] = rcu_rebuilds.load();
+        if(Mode == 2) {
+            delete rcu_locked;
+        } else {
+            state.counters["retired"] = rcu_shared->reclaim();
+            delete rcu_shared;
+        }
+    }
+}
+BENCHMARK_TEMPLATE(fash_rcu_bmk, 0)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_rcu_bmk, 1)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+BENCHMARK_TEMPLATE(fash_rcu_bmk, 2)->Arg(20)->ThreadRange(1, 32)->UseRealTime();
+
+#ifdef FASH_STATS
+// measured probe behaviour at nominal fill, for capacity planning. the counters
+// come from stats() after the run (hits with arg 0, misses with arg 1), and the
+// full stats, histograms included, go to stderr as one json object per run
+// (fixed iterations, so each run is a single call).
+template <class T>
+static void fash_stats_bmk(benchmark::State &state) {
+    auto bits  = state.range(0);
+    auto n = 1 << bits;
+    uint64_t offset = state.range(1) ? (1ULL << 40) : (1 << 20);
+    T table(bits);
+
+    for(int i = 0; i < n; ++i) {
+        table.try_insert_int64(i + (1<<20), i);
+    }
+
+    table.reset_probes();
+    for (auto _ : state)
+    {
+        for(int i = 0; i < n; i++)  {
+            auto found = table.find_int64(i + offset);
+            benchmark::DoNotOptimize(found);
+            benchmark::ClobberMemory();
+        }
+    }
+
+    const auto stats = table.stats();
+    state.counters["load"] = stats.load_factor();
+    state.counters["lines_per_lookup"] = stats.lines_per_lookup();
+    state.counters["mean_distance"] = stats.mean_distance();
+    state.counters["overflows"] = stats.overflows;
+    std::cerr << "{\"bits\":" << bits << ",\"miss\":" << state.range(1) << ",\"stats\":" << stats.json() << "}" << std::endl;
+}
+#define STATS_ARGS ->ArgsProduct({{12, 16, 20, 24}, {0, 1}})->Iterations(5);
+BENCHMARK_TEMPLATE(fash_stats_bmk, fash128x<uint64_t, uint64_t>)STATS_ARGS
+BENCHMARK_TEMPLATE(fash_stats_bmk, fash<uint64_t, uint64_t>)STATS_ARGS
+#endif
+
 BENCHMARK_MAIN();